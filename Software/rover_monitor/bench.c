@@ -0,0 +1,190 @@
+/*
+ * bench.c - render and transport microbenchmarks
+ *
+ * Runs the display code against the virtual transport (ssd1306_virtual.h),
+ * which counts the I2C transactions and bytes a real panel would get, so
+ * frame costs can be compared on any Linux box. Pushes run synchronously
+ * (no render thread), so update times include the transport work.
+ *
+ *   make bench && ./bench [min_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ina260.h"
+#include "energy.h"
+#include "oled_widget.h"
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+#include "ssd1306_virtual.h"
+#include "status_screen.h"
+
+#define BENCH_MIN_MS 200        // grow the iteration count until a run takes this long
+
+static const char bench_text[] = "Bat:  14.52V,   3.27A";
+
+static struct ina260_sample bench_bat;
+static struct energy_totals bench_energy;
+static unsigned long bench_i;
+
+static uint64_t
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ---- Benchmarked operations, one op per call ----
+
+static void
+op_text (void)
+{
+  draw_text_prop (0, 30, bench_text);
+}
+
+static void
+op_set_pixel (void)
+{
+  unsigned long i = bench_i++;
+  ssd1306_set_pixel (i % SSD1306_WIDTH, (i / SSD1306_WIDTH) % SSD1306_HEIGHT, i & 1);
+}
+
+static void
+draw_status (double tempC)
+{
+  draw_status_screen ("rover", "192.168.1.42", "rovernet", tempC, "0d 01:23",
+                      &bench_bat, &bench_energy, 1);
+}
+
+// Whole page from scratch, as after another page had the screen. Every
+// other frame shows different readings so the panel diff isn't empty.
+static void
+op_status_full (void)
+{
+  static const struct ina260_sample bat2 = {.voltage_raw = 9000,.current_raw = 800 };
+  static const struct energy_totals energy2 = {.run_mAh = 56,.run_mWh = 790 };
+  int odd = bench_i++ & 1;
+
+  ssd1306_lock ();
+  status_page_hide ();
+  ssd1306_unlock ();
+  if (odd)
+    draw_status_screen ("rover-dev", "10.0.0.7", "lab", 61.5, "3d 22:05", &bat2, &energy2, 0);
+  else
+    draw_status (45.0);
+}
+
+// Typical refresh: only the CPU temperature changed
+static void
+op_status_incr (void)
+{
+  draw_status ((bench_i++ & 1) ? 45.0 : 46.0);
+}
+
+// Every pixel changed
+static void
+op_update_full (void)
+{
+  ssd1306_fill_rect (0, 0, SSD1306_WIDTH, SSD1306_HEIGHT, bench_i++ & 1);
+  ssd1306_update ();
+}
+
+// One text line changed
+static void
+op_update_line (void)
+{
+  ssd1306_fill_rect (0, 30, SSD1306_WIDTH, OLED_FIELD_LINE_H, false);
+  draw_text_prop (0, 30, (bench_i++ & 1) ? bench_text : "Bat:  --");
+  ssd1306_update ();
+}
+
+// Nothing changed
+static void
+op_update_idle (void)
+{
+  ssd1306_update ();
+}
+
+struct bench
+{
+  const char *name;
+  void (*setup) (void);
+  void (*op) (void);
+};
+
+static void
+setup_clear (void)
+{
+  ssd1306_clear ();
+  ssd1306_update ();
+}
+
+static void
+setup_status (void)
+{
+  setup_clear ();
+  op_status_full ();
+}
+
+static const struct bench benches[] = {
+  {"draw_text_prop", setup_clear, op_text},
+  {"ssd1306_set_pixel", setup_clear, op_set_pixel},
+  {"status_screen_full", setup_clear, op_status_full},
+  {"status_screen_incr", setup_status, op_status_incr},
+  {"update_full", setup_clear, op_update_full},
+  {"update_line", setup_clear, op_update_line},
+  {"update_idle", setup_clear, op_update_idle},
+};
+
+static void
+run (const struct bench *b, uint64_t min_ns)
+{
+  struct ssd1306_virtual_stats s0, s1;
+  unsigned long n = 1;
+  uint64_t t;
+
+  for (;;) {
+    b->setup ();
+    bench_i = 0;
+    ssd1306_virtual_get_stats (&s0);
+    t = now_ns ();
+    for (unsigned long i = 0; i < n; i++)
+      b->op ();
+    t = now_ns () - t;
+    ssd1306_virtual_get_stats (&s1);
+    if (t >= min_ns || n >= (1ul << 30))
+      break;
+    n *= 2;
+  }
+  printf ("%-20s %10lu %10.1f %10.2f %10.1f\n", b->name, n, (double) t / n,
+          (double) (s1.xfers - s0.xfers) / n, (double) (s1.bytes - s0.bytes) / n);
+}
+
+int
+main (int argc, char **argv)
+{
+  uint64_t min_ns = (argc > 1 ? strtoul (argv[1], NULL, 0) : BENCH_MIN_MS) * 1000000ull;
+
+  bench_bat.voltage_raw = INA260_mV_TO_RAW (14520);
+  bench_bat.current_raw = INA260_mA_TO_RAW (3270);
+  bench_energy.run_mAh = 1234;
+  bench_energy.run_mWh = 17800;
+
+  ssd1306_set_transport (&ssd1306_virtual_transport);
+  if (ssd1306_init () < 0) {
+    fprintf (stderr, "ssd1306_init failed\n");
+    return 1;
+  }
+  status_page_init (INA260_mV_TO_RAW (11000), INA260_mV_TO_RAW (17000), INA260_mA_TO_RAW (7000));
+
+  printf ("%-20s %10s %10s %10s %10s\n", "benchmark", "ops", "ns/op", "xfers/op", "bytes/op");
+  for (size_t i = 0; i < sizeof (benches) / sizeof (benches[0]); i++)
+    run (&benches[i], min_ns);
+
+  ssd1306_shutdown ();
+  return 0;
+}
@@ -2,6 +2,9 @@
  *
  * Implementation for libgpiod v1.6.3 button helper.
  *
+ * No threads of its own: the caller polls buttons_fd() (poll/epoll) and
+ * calls buttons_dispatch() when it is readable; callbacks run there.
+ *
  * Build (with a separate main.c):
  *   gcc -Wall -O2 -c buttons.c
  *   gcc -Wall -O2 main.c buttons.o -lgpiod -lpthread -o app
@@ -13,13 +16,13 @@
 
 #include <gpiod.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <unistd.h>   // pause()
 
 // ---------- Configuration ----------
 #ifndef BUTTONS_GPIOCHIP_PATH
@@ -30,9 +33,6 @@
 #define BUTTONS_DEBOUNCE_MS 40
 #endif
 
-#ifndef BUTTONS_RELEASE_POLL_MS
-#define BUTTONS_RELEASE_POLL_MS 5
-#endif
 // -----------------------------------
 
 /* =========================
@@ -43,12 +43,11 @@ struct btn_ctx {
     int pin;
     struct gpiod_line *line;
 
-    pthread_t thread;
-    int thread_started;
-
     button_cb_t cb;
 
+    int pressed;                /* accepted a press, no release seen yet */
     int64_t last_accept_ns;
+    int64_t last_release_ns;
     int64_t debounce_ns;
 };
 
@@ -56,7 +55,6 @@ static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
 static struct gpiod_chip *g_chip = NULL;
 static struct btn_ctx g_btn[2];
 static int g_inited = 0;
-static volatile int g_stop = 0;
 
 static void _print_err(const char *where) {
     fprintf(stderr, "%s: %s\n", where, strerror(errno));
@@ -66,82 +64,29 @@ static inline int64_t _ts_to_ns(const struct timespec *ts) {
     return (int64_t)ts->tv_sec * 1000000000LL + (int64_t)ts->tv_nsec;
 }
 
-static void _sleep_ms(int ms) {
-    struct timespec ts;
-    ts.tv_sec = ms / 1000;
-    ts.tv_nsec = (long)(ms % 1000) * 1000L * 1000L;
-    nanosleep(&ts, NULL);
-}
-
-/* Pull-up wiring: released=1, pressed=0 */
-static void _wait_for_release_pullup(struct gpiod_line *line, int pin) {
-    while (!g_stop) {
-        int v = gpiod_line_get_value(line);
-        if (v < 0) {
-            fprintf(stderr, "GPIO %d get_value error: %s\n", pin, strerror(errno));
-            return; // during shutdown, don't hard-exit
-        }
-        if (v == 1) return; // released
-        _sleep_ms(BUTTONS_RELEASE_POLL_MS);
-    }
-}
-
-static void *_button_thread(void *arg) {
-    struct btn_ctx *ctx = (struct btn_ctx *)arg;
-
-    for (;;) {
-        if (g_stop) break;
-
-        /* Use a finite timeout so shutdown doesn't hang waiting forever */
-        struct timespec timeout = { .tv_sec = 0, .tv_nsec = 200 * 1000 * 1000 }; // 200ms
-        int w = gpiod_line_event_wait(ctx->line, &timeout);
-        if (w < 0) {
-            if (g_stop) break;
-            fprintf(stderr, "GPIO %d event_wait error: %s\n", ctx->pin, strerror(errno));
-            break;
-        }
-        if (w == 0) continue; // timeout, loop to check g_stop
-
-        /* Drain queued events */
-        for (;;) {
-            if (g_stop) break;
-
-            struct gpiod_line_event ev;
-            if (gpiod_line_event_read(ctx->line, &ev) < 0) {
-                if (errno == EAGAIN) { errno = 0; break; }
-                if (g_stop) break;
-                fprintf(stderr, "GPIO %d event_read error: %s\n", ctx->pin, strerror(errno));
-                break;
-            }
-
-            /* press-only for pull-up: FALLING edge (1 -> 0) */
-            if (ev.event_type != GPIOD_LINE_EVENT_FALLING_EDGE)
-                continue;
-
-            /* debounce */
-            int64_t now_ns = _ts_to_ns(&ev.ts);
-            if (ctx->last_accept_ns >= 0 &&
-                (now_ns - ctx->last_accept_ns) < ctx->debounce_ns) {
-                continue;
-            }
-            ctx->last_accept_ns = now_ns;
-
-            /* callback */
-            button_cb_t cb_local = NULL;
-
-            /* Take a local copy under lock so callback registration is thread-safe */
-            pthread_mutex_lock(&g_lock);
-            cb_local = ctx->cb;
-            pthread_mutex_unlock(&g_lock);
-
-            if (cb_local) cb_local(ctx->pin);
+/* Pull-up wiring: a press is a FALLING edge (1 -> 0), a release RISING.
+ * A press is accepted once per press/release cycle, and only when both
+ * the last press and the last release are a debounce time old, so
+ * contact bounce on either edge never fires the callback twice.
+ * Returns 1 if ev is an accepted press.
+ */
+static int _accept_press(struct btn_ctx *ctx, const struct gpiod_line_event *ev) {
+    int64_t now_ns = _ts_to_ns(&ev->ts);
 
-            /* release gate */
-            _wait_for_release_pullup(ctx->line, ctx->pin);
-        }
+    if (ev->event_type == GPIOD_LINE_EVENT_RISING_EDGE) {
+        ctx->pressed = 0;
+        ctx->last_release_ns = now_ns;
+        return 0;
     }
-
-    return NULL;
+    if (ctx->pressed)
+        return 0;
+    if (ctx->last_accept_ns >= 0 && (now_ns - ctx->last_accept_ns) < ctx->debounce_ns)
+        return 0;
+    if (ctx->last_release_ns >= 0 && (now_ns - ctx->last_release_ns) < ctx->debounce_ns)
+        return 0;
+    ctx->pressed = 1;
+    ctx->last_accept_ns = now_ns;
+    return 1;
 }
 
 static struct btn_ctx *_find_ctx(int pin_num) {
@@ -169,7 +114,6 @@ int buttons_init(int pin_num1, int pin_num2) {
         return -1;
     }
 
-    g_stop = 0;
     memset(g_btn, 0, sizeof(g_btn));
 
     g_chip = gpiod_chip_open(BUTTONS_GPIOCHIP_PATH);
@@ -184,6 +128,7 @@ int buttons_init(int pin_num1, int pin_num2) {
 
     for (int i = 0; i < 2; i++) {
         g_btn[i].last_accept_ns = -1;
+        g_btn[i].last_release_ns = -1;
         g_btn[i].debounce_ns = (int64_t)BUTTONS_DEBOUNCE_MS * 1000LL * 1000LL;
         g_btn[i].cb = NULL;
 
@@ -195,23 +140,23 @@ int buttons_init(int pin_num1, int pin_num2) {
             return -1;
         }
 
-        if (gpiod_line_request_falling_edge_events(g_btn[i].line, "buttons_lib") < 0) {
-            fprintf(stderr, "request_falling_edge_events failed for GPIO %d: %s\n",
+        /* Both edges: releases re-arm the press detection (see _accept_press) */
+        if (gpiod_line_request_both_edges_events(g_btn[i].line, "buttons_lib") < 0) {
+            fprintf(stderr, "request_both_edges_events failed for GPIO %d: %s\n",
                     g_btn[i].pin, strerror(errno));
             pthread_mutex_unlock(&g_lock);
             buttons_shutdown(); // cleanup partial init
             return -1;
         }
-    }
 
-    for (int i = 0; i < 2; i++) {
-        if (pthread_create(&g_btn[i].thread, NULL, _button_thread, &g_btn[i]) != 0) {
-            fprintf(stderr, "pthread_create failed for GPIO %d\n", g_btn[i].pin);
+        /* Reads return EAGAIN once the queue is drained */
+        int fd = gpiod_line_event_get_fd(g_btn[i].line);
+        if (fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+            fprintf(stderr, "GPIO %d: can't make event fd non-blocking\n", g_btn[i].pin);
             pthread_mutex_unlock(&g_lock);
             buttons_shutdown(); // cleanup partial init
             return -1;
         }
-        g_btn[i].thread_started = 1;
     }
 
     g_inited = 1;
@@ -240,40 +185,68 @@ int button_callback(int pin_num, button_cb_t cb) {
     return 0;
 }
 
-int buttons_shutdown(void) {
+int buttons_fd(int pin_num) {
+    int fd = -1;
+
     pthread_mutex_lock(&g_lock);
+    struct btn_ctx *ctx = g_inited ? _find_ctx(pin_num) : NULL;
+    if (ctx)
+        fd = gpiod_line_event_get_fd(ctx->line);
+    pthread_mutex_unlock(&g_lock);
+    return fd;
+}
 
-    if (!g_inited && !g_chip) {
-        pthread_mutex_unlock(&g_lock);
-        return 0; // nothing to do
-    }
+int buttons_dispatch(int pin_num) {
+    struct btn_ctx *ctx;
+    int presses = 0;
 
-    g_stop = 1;
+    pthread_mutex_lock(&g_lock);
+    ctx = g_inited ? _find_ctx(pin_num) : NULL;
+    pthread_mutex_unlock(&g_lock);
+    if (!ctx)
+        return -1;
 
-    /* Copy thread handles locally so we can join without holding the lock */
-    pthread_t t0 = g_btn[0].thread;
-    pthread_t t1 = g_btn[1].thread;
-    int s0 = g_btn[0].thread_started;
-    int s1 = g_btn[1].thread_started;
+    /* Drain queued events; the fd is non-blocking */
+    for (;;) {
+        struct gpiod_line_event ev;
+        if (gpiod_line_event_read(ctx->line, &ev) < 0) {
+            if (errno == EAGAIN) { errno = 0; break; }
+            fprintf(stderr, "GPIO %d event_read error: %s\n", ctx->pin, strerror(errno));
+            return -1;
+        }
+        if (!_accept_press(ctx, &ev))
+            continue;
 
-    pthread_mutex_unlock(&g_lock);
+        /* Take a local copy under lock so callback registration is thread-safe */
+        pthread_mutex_lock(&g_lock);
+        button_cb_t cb_local = ctx->cb;
+        pthread_mutex_unlock(&g_lock);
 
-    /* Join threads (they wake at most within the event_wait timeout) */
-    if (s0) pthread_join(t0, NULL);
-    if (s1) pthread_join(t1, NULL);
+        if (cb_local) cb_local(ctx->pin);
+        presses++;
+    }
+    return presses;
+}
 
+int buttons_shutdown(void) {
     pthread_mutex_lock(&g_lock);
 
+    if (!g_inited && !g_chip) {
+        pthread_mutex_unlock(&g_lock);
+        return 0; // nothing to do
+    }
+
     /* Release lines */
     for (int i = 0; i < 2; i++) {
         if (g_btn[i].line) {
             gpiod_line_release(g_btn[i].line);
             g_btn[i].line = NULL;
         }
-        g_btn[i].thread_started = 0;
         g_btn[i].cb = NULL;
         g_btn[i].pin = 0;
+        g_btn[i].pressed = 0;
         g_btn[i].last_accept_ns = -1;
+        g_btn[i].last_release_ns = -1;
     }
 
     /* Close chip */
@@ -291,7 +264,7 @@ int buttons_shutdown(void) {
 /* --------------------- Unit test main() ---------------------
  * Enable by changing #if 0 to #if 1 above.
  *
- * Build:
+ * Build (add #include <poll.h>):
  *   gcc -Wall -O2 buttons.c -lgpiod -lpthread -o buttons_test
  * Run:
  *   sudo ./buttons_test
@@ -314,7 +287,15 @@ int main(void) {
     printf("Buttons initialized. Press GPIO19/21. Ctrl-C to stop.\n");
     fflush(stdout);
 
-    for (;;) pause();
+    struct pollfd pfd[2] = {
+        { .fd = buttons_fd(19), .events = POLLIN },
+        { .fd = buttons_fd(21), .events = POLLIN },
+    };
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) break;
+        if (pfd[0].revents & POLLIN) buttons_dispatch(19);
+        if (pfd[1].revents & POLLIN) buttons_dispatch(21);
+    }
 
     // If you ever break out, clean shutdown:
     // buttons_shutdown();
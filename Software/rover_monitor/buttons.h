@@ -3,6 +3,8 @@
  * Public interface for libgpiod v1.6.3 button helper.
  * Raspberry Pi: BCM GPIO numbers (gpiod offsets), pull-up wiring (idle=1, press=0),
  * press-only (FALLING), debounce + release gate.
+ * Event driven without threads: poll buttons_fd() and call
+ * buttons_dispatch() when it is readable.
  */
 
 #ifndef BUTTONS_H
@@ -24,7 +26,18 @@ int buttons_init(int pin_num1, int pin_num2);
  */
 int button_callback(int pin_num, button_cb_t cb);
 
-/* Stop threads, release lines, close chip.
+/* Line event fd for a pin, to poll for POLLIN / EPOLLIN.
+ * Returns -1 if the pin isn't initialized.
+ */
+int buttons_fd(int pin_num);
+
+/* Read the pin's queued edge events and run its callback for each
+ * accepted press, on the calling thread. Never blocks.
+ * Returns the number of presses, or -1 on error.
+ */
+int buttons_dispatch(int pin_num);
+
+/* Release lines, close chip.
  * Safe to call even if not initialized (returns 0).
  * Returns 0 on success, -1 on error.
  */
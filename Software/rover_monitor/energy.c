@@ -0,0 +1,182 @@
+/* energy.c
+ *
+ * Trapezoidal integration of current and V*I power over sample
+ * timestamps. Gaps longer than ENERGY_MAX_GAP_NS (sensor offline,
+ * reader overrun) are not bridged, so a dropout never turns into a
+ * large bogus step.
+ */
+
+#include "energy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef ENERGY_MAX_GAP_NS
+#define ENERGY_MAX_GAP_NS (500LL * 1000 * 1000)    // 500 ms
+#endif
+
+#define NS_PER_HOUR (3600.0 * 1e9)
+
+static char g_path[256];
+static struct sample_ring *g_ring = NULL;
+static struct sample_ring_reader g_rd;
+static struct energy_totals g_tot;
+static struct ina260_sample g_prev;
+static int g_have_prev = 0;
+static int g_no_save = 0;       // state file exists but couldn't be read; never overwrite it
+
+static int64_t _ts_ns(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+/* Lines that parse are kept even if others don't. A file with lines we
+ * don't understand is renamed to <path>.bad before the first save
+ * replaces it; one we can't read (EACCES, EIO) is left alone and
+ * energy_save() stops writing, so the pack's history is never lost.
+ */
+static int _load(void) {
+    FILE *f = fopen(g_path, "r");
+    if (!f) {
+        if (errno == ENOENT)
+            return 0;
+        fprintf(stderr, "energy_init: %s: %s, not saving lifetime totals\n",
+                g_path, strerror(errno));
+        g_no_save = 1;
+        return -1;
+    }
+
+    char line[128];
+    int rc = 0;
+    while (fgets(line, sizeof(line), f)) {
+        double v;
+        if (sscanf(line, "life_mAh=%lf", &v) == 1)
+            g_tot.life_mAh = v;
+        else if (sscanf(line, "life_mWh=%lf", &v) == 1)
+            g_tot.life_mWh = v;
+        else if (line[0] != '#' && line[0] != '\n')
+            rc = -1;
+    }
+    if (ferror(f)) {
+        fprintf(stderr, "energy_init: %s: read error, not saving lifetime totals\n", g_path);
+        g_no_save = 1;
+        rc = -1;
+    }
+    fclose(f);
+    if (rc == 0 || g_no_save)
+        return rc;
+
+    char bad[sizeof(g_path) + 8];
+    snprintf(bad, sizeof(bad), "%s.bad", g_path);
+    if (rename(g_path, bad) == 0) {
+        fprintf(stderr, "energy_init: %s has unknown lines, kept as %s\n", g_path, bad);
+    } else {
+        fprintf(stderr, "energy_init: %s has unknown lines and can't be moved aside: %s, "
+                "not saving lifetime totals\n", g_path, strerror(errno));
+        g_no_save = 1;
+    }
+    return -1;
+}
+
+int energy_init(const char *state_path, struct sample_ring *ring) {
+    memset(&g_tot, 0, sizeof(g_tot));
+    snprintf(g_path, sizeof(g_path), "%s", state_path);
+    g_ring = ring;
+    g_have_prev = 0;
+    g_no_save = 0;
+    if (g_ring)
+        sample_ring_reader_init(g_ring, &g_rd);
+
+    return _load();
+}
+
+static void _integrate(const struct ina260_sample *s) {
+    if (g_have_prev) {
+        int64_t dt = _ts_ns(&s->ts) - _ts_ns(&g_prev.ts);
+        if (dt > 0 && dt <= ENERGY_MAX_GAP_NS) {
+            double i_avg = 0.5 * ina260_raw_to_mA(g_prev.current_raw + s->current_raw);
+            double p_avg = 0.5 * ((double)g_prev.voltage_raw * g_prev.current_raw +
+                                  (double)s->voltage_raw * s->current_raw) *
+                           (INA260_VOLTAGE_uV_PER_LSB / 1000.0) *
+                           (INA260_CURRENT_uA_PER_LSB / 1000.0) / 1000.0;   // mW
+            double mAh = i_avg * dt / NS_PER_HOUR;
+            double mWh = p_avg * dt / NS_PER_HOUR;
+            g_tot.run_mAh += mAh;
+            g_tot.run_mWh += mWh;
+            g_tot.life_mAh += mAh;
+            g_tot.life_mWh += mWh;
+        }
+    }
+    g_prev = *s;
+    g_have_prev = 1;
+}
+
+void energy_update(void) {
+    struct ina260_sample batch[64];
+    int n;
+
+    if (!g_ring)
+        return;
+    while ((n = sample_ring_read(g_ring, &g_rd, batch, 64)) > 0) {
+        for (int i = 0; i < n; i++)
+            _integrate(&batch[i]);
+    }
+}
+
+void energy_get(struct energy_totals *out) {
+    *out = g_tot;
+}
+
+int energy_save(void) {
+    char tmp[sizeof(g_path) + 8];
+    char buf[128];
+
+    if (g_no_save)
+        return -1;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_path);
+    int len = snprintf(buf, sizeof(buf), "life_mAh=%.6f\nlife_mWh=%.6f\n",
+                       g_tot.life_mAh, g_tot.life_mWh);
+
+    /* Create the state directory on first use */
+    char dir[sizeof(g_path)];
+    snprintf(dir, sizeof(dir), "%s", g_path);
+    char *d = dirname(dir);
+    if (mkdir(d, 0755) < 0 && errno != EEXIST) {
+        perror("energy_save: mkdir");
+        return -1;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("energy_save: open");
+        return -1;
+    }
+    if (write(fd, buf, len) != len || fsync(fd) < 0) {
+        perror("energy_save: write");
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(tmp, g_path) < 0) {
+        perror("energy_save: rename");
+        unlink(tmp);
+        return -1;
+    }
+
+    /* Make the rename itself durable */
+    int dfd = open(d, O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return 0;
+}
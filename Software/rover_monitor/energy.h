@@ -0,0 +1,55 @@
+/* energy.h
+ *
+ * Coulomb counter / energy integrator for the battery feed. Integrates
+ * every INA260 sample from the acquisition ring (trapezoidal rule over
+ * CLOCK_MONOTONIC timestamps) into charge and energy used this run and
+ * over the pack's lifetime. Lifetime totals persist in a small state
+ * file that is replaced atomically, so a crash or power cut leaves
+ * either the old or the new totals, never a torn file.
+ */
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include "sample_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef ENERGY_STATE_PATH
+#define ENERGY_STATE_PATH "/var/lib/rover_monitor/energy.state"
+#endif
+
+struct energy_totals {
+    double run_mAh;     /* since this monitor started */
+    double run_mWh;
+    double life_mAh;    /* persisted across restarts */
+    double life_mWh;
+};
+
+/* Load lifetime totals from state_path (missing file = start at zero)
+ * and start reading the ring from its current head.
+ * Returns 0 on success, -1 if the file exists but could not be fully
+ * read. Totals that did parse are kept and the file is renamed to
+ * <path>.bad; if it can't be opened or moved, energy_save() won't
+ * overwrite it.
+ */
+int energy_init(const char *state_path, struct sample_ring *ring);
+
+/* Integrate all samples pushed since the last call. */
+void energy_update(void);
+
+void energy_get(struct energy_totals *out);
+
+/* Write lifetime totals to the state file (tmp + fsync + rename).
+ * Returns 0 on success, -1 on error or if saving is disabled (see
+ * energy_init()).
+ */
+int energy_save(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENERGY_H */
@@ -0,0 +1,281 @@
+/* event_loop.c
+ *
+ * Sources live in a fixed table; the epoll data points at the entry.
+ * Timer, signal and pidfds are created (and closed) here, plain fds
+ * belong to the caller.
+ */
+
+#include "event_loop.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434      /* same number on every architecture */
+#endif
+
+enum src_kind { SRC_FREE = 0, SRC_FD, SRC_TIMER, SRC_SIGNAL, SRC_CHILD };
+
+struct ev_source {
+    enum src_kind kind;
+    int fd;
+    evloop_cb_t cb;
+    evloop_signal_cb_t sig_cb;
+    evloop_child_cb_t child_cb;
+    pid_t pid;
+    void *arg;
+};
+
+static int g_epfd = -1;
+static int g_stop = 0;
+static struct ev_source g_src[EVLOOP_MAX_SOURCES];
+
+// The mask from before the first evloop_add_signals(), for child processes
+static sigset_t g_child_mask;
+static int g_child_mask_saved = 0;
+
+static struct ev_source *_add(int fd, uint32_t events, enum src_kind kind) {
+    struct ev_source *s = NULL;
+
+    for (int i = 0; i < EVLOOP_MAX_SOURCES; i++) {
+        if (g_src[i].kind == SRC_FREE) {
+            s = &g_src[i];
+            break;
+        }
+    }
+    if (!s) {
+        fprintf(stderr, "evloop: more than %d sources\n", EVLOOP_MAX_SOURCES);
+        return NULL;
+    }
+
+    struct epoll_event ev = { .events = events, .data.ptr = s };
+    if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("evloop: epoll_ctl");
+        return NULL;
+    }
+    memset(s, 0, sizeof(*s));
+    s->kind = kind;
+    s->fd = fd;
+    return s;
+}
+
+static void _ms_to_ts(unsigned int ms, struct timespec *ts) {
+    ts->tv_sec = ms / 1000;
+    ts->tv_nsec = (long)(ms % 1000) * 1000000L;
+}
+
+int evloop_init(void) {
+    g_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_epfd < 0) {
+        perror("evloop: epoll_create1");
+        return -1;
+    }
+    memset(g_src, 0, sizeof(g_src));
+    g_stop = 0;
+    return 0;
+}
+
+int evloop_add_fd(int fd, uint32_t events, evloop_cb_t cb, void *arg) {
+    struct ev_source *s = _add(fd, events, SRC_FD);
+    if (!s)
+        return -1;
+    s->cb = cb;
+    s->arg = arg;
+    return 0;
+}
+
+int evloop_del_fd(int fd) {
+    for (int i = 0; i < EVLOOP_MAX_SOURCES; i++) {
+        if (g_src[i].kind != SRC_FREE && g_src[i].fd == fd) {
+            epoll_ctl(g_epfd, EPOLL_CTL_DEL, fd, NULL);
+            g_src[i].kind = SRC_FREE;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int evloop_set_timer(int tfd, unsigned int first_ms, unsigned int period_ms) {
+    struct itimerspec its;
+
+    _ms_to_ts(first_ms, &its.it_value);
+    _ms_to_ts(period_ms, &its.it_interval);
+    if (timerfd_settime(tfd, 0, &its, NULL) < 0) {
+        perror("evloop: timerfd_settime");
+        return -1;
+    }
+    return 0;
+}
+
+int evloop_add_timer(unsigned int first_ms, unsigned int period_ms, evloop_cb_t cb, void *arg) {
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) {
+        perror("evloop: timerfd_create");
+        return -1;
+    }
+
+    struct ev_source *s = _add(tfd, EPOLLIN, SRC_TIMER);
+    if (!s || evloop_set_timer(tfd, first_ms, period_ms) < 0) {
+        if (s)
+            evloop_del_fd(tfd);
+        close(tfd);
+        return -1;
+    }
+    s->cb = cb;
+    s->arg = arg;
+    return tfd;
+}
+
+static void _atfork_child(void) {
+    // A forked child would otherwise start with our signals blocked
+    sigprocmask(SIG_SETMASK, &g_child_mask, NULL);
+}
+
+int evloop_add_signals(const int *sigs, int n, evloop_signal_cb_t cb, void *arg) {
+    sigset_t mask, old;
+
+    sigemptyset(&mask);
+    for (int i = 0; i < n; i++)
+        sigaddset(&mask, sigs[i]);
+    if (pthread_sigmask(SIG_BLOCK, &mask, &old) != 0) {
+        fprintf(stderr, "evloop: pthread_sigmask failed\n");
+        return -1;
+    }
+    if (!g_child_mask_saved) {
+        g_child_mask = old;
+        g_child_mask_saved = 1;
+        pthread_atfork(NULL, NULL, _atfork_child);
+    }
+
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0) {
+        perror("evloop: signalfd");
+        return -1;
+    }
+
+    struct ev_source *s = _add(sfd, EPOLLIN, SRC_SIGNAL);
+    if (!s) {
+        close(sfd);
+        return -1;
+    }
+    s->sig_cb = cb;
+    s->arg = arg;
+    return 0;
+}
+
+static void _dispatch(struct ev_source *s, uint32_t events) {
+    switch (s->kind) {
+    case SRC_FD:
+        s->cb(s->fd, events, s->arg);
+        break;
+
+    case SRC_TIMER: {
+        uint64_t expirations;
+        // EAGAIN if the timer was re-armed since epoll_wait() saw it
+        if (read(s->fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+            s->cb(s->fd, (uint32_t)expirations, s->arg);
+        break;
+    }
+
+    case SRC_SIGNAL: {
+        struct signalfd_siginfo si;
+        while (read(s->fd, &si, sizeof(si)) == sizeof(si))
+            s->sig_cb((int)si.ssi_signo, s->arg);
+        break;
+    }
+
+    case SRC_CHILD: {
+        int status = 0;
+        pid_t r = waitpid(s->pid, &status, WNOHANG);
+        if (r == 0)
+            break;
+        if (r < 0)
+            status = -1;
+        // Free the entry first, the callback may add the next child
+        pid_t pid = s->pid;
+        evloop_child_cb_t cb = s->child_cb;
+        void *arg = s->arg;
+        evloop_del_fd(s->fd);
+        close(s->fd);
+        if (cb)
+            cb(pid, status, arg);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+int evloop_add_child(pid_t pid, evloop_child_cb_t cb, void *arg) {
+    // A pidfd turns readable once the process has exited
+    int pfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pfd < 0) {
+        perror("evloop: pidfd_open");
+        return -1;
+    }
+
+    struct ev_source *s = _add(pfd, EPOLLIN, SRC_CHILD);
+    if (!s) {
+        close(pfd);
+        return -1;
+    }
+    s->child_cb = cb;
+    s->pid = pid;
+    s->arg = arg;
+    return 0;
+}
+
+void evloop_child_sigmask(sigset_t *mask) {
+    if (g_child_mask_saved)
+        *mask = g_child_mask;
+    else
+        pthread_sigmask(SIG_SETMASK, NULL, mask);
+}
+
+int evloop_run(void) {
+    struct epoll_event evs[EVLOOP_MAX_SOURCES];
+
+    g_stop = 0;
+    while (!g_stop) {
+        int n = epoll_wait(g_epfd, evs, EVLOOP_MAX_SOURCES, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("evloop: epoll_wait");
+            return -1;
+        }
+        for (int i = 0; i < n && !g_stop; i++) {
+            struct ev_source *s = evs[i].data.ptr;
+            // A callback earlier in this batch may have removed it
+            if (s->kind != SRC_FREE)
+                _dispatch(s, evs[i].events);
+        }
+    }
+    return 0;
+}
+
+void evloop_stop(void) {
+    g_stop = 1;
+}
+
+void evloop_close(void) {
+    for (int i = 0; i < EVLOOP_MAX_SOURCES; i++) {
+        if (g_src[i].kind == SRC_TIMER || g_src[i].kind == SRC_SIGNAL
+            || g_src[i].kind == SRC_CHILD)
+            close(g_src[i].fd);
+        g_src[i].kind = SRC_FREE;
+    }
+    if (g_epfd >= 0) {
+        close(g_epfd);
+        g_epfd = -1;
+    }
+}
@@ -0,0 +1,89 @@
+/* event_loop.h
+ *
+ * Single-threaded epoll loop. Sources are file descriptors: device fds
+ * (e.g. gpiod line event fds), timerfds for periodic work and a signalfd
+ * for the process signals. The loop sleeps in epoll_wait() until one of
+ * them is ready, then runs its callback on the loop thread.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef EVLOOP_MAX_SOURCES
+#define EVLOOP_MAX_SOURCES 16
+#endif
+
+/* Called on the loop thread. For timers, fd is the timerfd and events
+ * holds the number of expirations since the last call (normally 1).
+ */
+typedef void (*evloop_cb_t)(int fd, uint32_t events, void *arg);
+
+/* Called with each signal number received through evloop_add_signals() */
+typedef void (*evloop_signal_cb_t)(int signo, void *arg);
+
+/* Called once a child from evloop_add_child() has exited and been reaped,
+ * with its waitpid() status (-1 if it could not be reaped).
+ */
+typedef void (*evloop_child_cb_t)(pid_t pid, int status, void *arg);
+
+/* Create the epoll instance. Returns 0 on success, -1 on error. */
+int evloop_init(void);
+
+/* Watch fd for events (EPOLLIN etc.). The loop does not own fd.
+ * Returns 0 on success, -1 on error.
+ */
+int evloop_add_fd(int fd, uint32_t events, evloop_cb_t cb, void *arg);
+int evloop_del_fd(int fd);
+
+/* Create a CLOCK_MONOTONIC timerfd that first fires after first_ms, then
+ * every period_ms (0 = one shot). first_ms 0 creates it disarmed.
+ * Returns the timerfd, or -1 on error.
+ */
+int evloop_add_timer(unsigned int first_ms, unsigned int period_ms, evloop_cb_t cb, void *arg);
+
+/* Re-arm a timer from evloop_add_timer(); first_ms 0 disarms it.
+ * Safe to call from any thread. Returns 0 on success, -1 on error.
+ */
+int evloop_set_timer(int tfd, unsigned int first_ms, unsigned int period_ms);
+
+/* Block the n signals in sigs and deliver them through a signalfd.
+ * Call before any other thread is created, so every thread inherits
+ * the blocked mask and the signals can only arrive here.
+ * Returns 0 on success, -1 on error.
+ */
+int evloop_add_signals(const int *sigs, int n, evloop_signal_cb_t cb, void *arg);
+
+/* Reap child pid on the loop once it exits, then call cb (may be NULL).
+ * Returns 0 on success, -1 on error (the child is not reaped then).
+ */
+int evloop_add_child(pid_t pid, evloop_child_cb_t cb, void *arg);
+
+/* The signal mask from before evloop_add_signals(), which child processes
+ * should start with. fork() children get it back automatically; system()
+ * and posix_spawn() do not, so spawn with posix_spawnattr_setsigmask().
+ */
+void evloop_child_sigmask(sigset_t *mask);
+
+/* Dispatch events until evloop_stop(). Returns 0, or -1 if epoll_wait fails. */
+int evloop_run(void);
+
+/* Make evloop_run() return after the current callback. Loop thread only. */
+void evloop_stop(void);
+
+/* Close the timers, the signalfd, any child pidfds and the epoll instance. */
+void evloop_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_LOOP_H */
@@ -0,0 +1,233 @@
+/* i2c_bus.c
+ *
+ * One fd, one in-flight transaction. The mutex only guards the
+ * ownership flag; the ioctl itself runs without it so waiters can
+ * queue up and the next owner is picked by priority when it finishes.
+ */
+
+#include "i2c_bus.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+static int g_fd = -1;
+static int g_refs = 0;
+static char g_path[64];
+static int g_busy = 0;
+static int g_high_waiting = 0;
+
+/* Indexed by 7-bit address; guarded by g_lock */
+static struct i2c_bus_stats g_stats[128];
+static int64_t g_open_ns = 0;
+
+static int64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void _account(struct i2c_bus_stats *st, size_t bytes, int64_t wait_ns,
+                     int64_t lat_ns, int err) {
+    st->xfers++;
+    st->bytes += bytes;
+    st->wait_ns += wait_ns;
+    st->busy_ns += lat_ns;
+    if ((uint64_t)lat_ns > st->max_ns)
+        st->max_ns = lat_ns;
+
+    int b = 0;
+    int64_t us = lat_ns / 1000;
+    while (b < I2C_BUS_HIST_BUCKETS - 1 && us >= (1LL << b))
+        b++;
+    st->hist[b]++;
+
+    switch (err) {
+    case 0:
+        break;
+    case ENXIO:
+    case EREMOTEIO:
+        st->nack++;
+        break;
+    case EIO:
+        st->eio++;
+        break;
+    case ETIMEDOUT:
+        st->timeout++;
+        break;
+    default:
+        st->other_err++;
+        break;
+    }
+}
+
+static void _acquire(enum i2c_bus_prio prio) {
+    pthread_mutex_lock(&g_lock);
+    if (prio == I2C_BUS_PRIO_HIGH) {
+        g_high_waiting++;
+        while (g_busy)
+            pthread_cond_wait(&g_cond, &g_lock);
+        g_high_waiting--;
+    } else {
+        while (g_busy || g_high_waiting > 0)
+            pthread_cond_wait(&g_cond, &g_lock);
+    }
+    g_busy = 1;
+    pthread_mutex_unlock(&g_lock);
+}
+
+/* Give up the bus and record the transaction that just finished */
+static void _release(uint8_t addr, size_t bytes, int64_t wait_ns, int64_t lat_ns, int err) {
+    pthread_mutex_lock(&g_lock);
+    _account(&g_stats[addr & 0x7F], bytes, wait_ns, lat_ns, err);
+    g_busy = 0;
+    pthread_cond_broadcast(&g_cond);
+    pthread_mutex_unlock(&g_lock);
+}
+
+int i2c_bus_open(const char *path) {
+    pthread_mutex_lock(&g_lock);
+
+    if (g_refs > 0) {
+        if (strcmp(path, g_path) != 0) {
+            fprintf(stderr, "i2c_bus_open: %s already open, can't open %s\n", g_path, path);
+            pthread_mutex_unlock(&g_lock);
+            return -1;
+        }
+        g_refs++;
+        pthread_mutex_unlock(&g_lock);
+        return 0;
+    }
+
+    g_fd = open(path, O_RDWR);
+    if (g_fd < 0) {
+        perror("i2c_bus_open");
+        pthread_mutex_unlock(&g_lock);
+        return -1;
+    }
+    snprintf(g_path, sizeof(g_path), "%s", path);
+    g_refs = 1;
+    g_open_ns = _now_ns();
+    memset(g_stats, 0, sizeof(g_stats));
+    pthread_mutex_unlock(&g_lock);
+    return 0;
+}
+
+void i2c_bus_close(void) {
+    pthread_mutex_lock(&g_lock);
+    if (g_refs > 0 && --g_refs == 0) {
+        close(g_fd);
+        g_fd = -1;
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+int i2c_bus_xfer(struct i2c_msg *msgs, int nmsgs, enum i2c_bus_prio prio) {
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = nmsgs };
+
+    if (g_fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    size_t bytes = 0;
+    for (int i = 0; i < nmsgs; i++)
+        bytes += msgs[i].len;
+
+    int64_t t0 = _now_ns();
+    _acquire(prio);
+    int64_t t1 = _now_ns();
+    int rc = ioctl(g_fd, I2C_RDWR, &xfer);
+    int err = (rc == nmsgs) ? 0 : (rc < 0) ? errno : EIO;
+    int64_t t2 = _now_ns();
+    _release(msgs[0].addr, bytes, t1 - t0, t2 - t1, err);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int i2c_bus_write(uint8_t addr, const uint8_t *buf, size_t len, enum i2c_bus_prio prio) {
+    struct i2c_msg msg = {
+        .addr = addr, .flags = 0, .len = (uint16_t)len, .buf = (uint8_t *)buf
+    };
+    return i2c_bus_xfer(&msg, 1, prio);
+}
+
+int i2c_bus_get_stats(uint8_t addr, struct i2c_bus_stats *out) {
+    pthread_mutex_lock(&g_lock);
+    *out = g_stats[addr & 0x7F];
+    pthread_mutex_unlock(&g_lock);
+    return out->xfers ? 0 : -1;
+}
+
+int i2c_bus_active_addrs(uint8_t *addrs, int max) {
+    int n = 0;
+    pthread_mutex_lock(&g_lock);
+    for (int a = 0; a < 128 && n < max; a++) {
+        if (g_stats[a].xfers)
+            addrs[n++] = (uint8_t)a;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return n;
+}
+
+unsigned long i2c_bus_percentile_us(const struct i2c_bus_stats *st, int pct) {
+    if (!st->xfers)
+        return 0;
+    unsigned long want = (st->xfers * (unsigned long)pct + 99) / 100;
+    unsigned long seen = 0;
+    for (int b = 0; b < I2C_BUS_HIST_BUCKETS; b++) {
+        seen += st->hist[b];
+        if (seen >= want)
+            return (b < I2C_BUS_HIST_BUCKETS - 1) ? (1UL << b) : st->max_ns / 1000;
+    }
+    return st->max_ns / 1000;
+}
+
+double i2c_bus_utilization(void) {
+    uint64_t busy = 0;
+    pthread_mutex_lock(&g_lock);
+    for (int a = 0; a < 128; a++)
+        busy += g_stats[a].busy_ns;
+    int64_t elapsed = _now_ns() - g_open_ns;
+    pthread_mutex_unlock(&g_lock);
+    return (g_refs && elapsed > 0) ? 100.0 * busy / elapsed : 0.0;
+}
+
+void i2c_bus_stats_dump(FILE *f) {
+    uint8_t addrs[128];
+    int n = i2c_bus_active_addrs(addrs, 128);
+
+    fprintf(f, "i2c %s: %.2f%% busy\n", g_path, i2c_bus_utilization());
+    for (int i = 0; i < n; i++) {
+        struct i2c_bus_stats st;
+        i2c_bus_get_stats(addrs[i], &st);
+        fprintf(f, "  0x%02X xfers=%lu bytes=%lu avg=%lluus p50<%luus p99<%luus max=%lluus "
+                "wait=%lluus nack=%lu eio=%lu timeout=%lu other=%lu\n",
+                addrs[i], st.xfers, st.bytes,
+                (unsigned long long)(st.busy_ns / st.xfers / 1000),
+                i2c_bus_percentile_us(&st, 50), i2c_bus_percentile_us(&st, 99),
+                (unsigned long long)(st.max_ns / 1000),
+                (unsigned long long)(st.wait_ns / st.xfers / 1000),
+                st.nack, st.eio, st.timeout, st.other_err);
+        fprintf(f, "       hist(us):");
+        for (int b = 0; b < I2C_BUS_HIST_BUCKETS; b++) {
+            if (st.hist[b])
+                fprintf(f, " %s%lu:%lu", (b < I2C_BUS_HIST_BUCKETS - 1) ? "<" : ">=",
+                        1UL << (b < I2C_BUS_HIST_BUCKETS - 1 ? b : b - 1), st.hist[b]);
+        }
+        fprintf(f, "\n");
+    }
+    fflush(f);
+}
@@ -0,0 +1,97 @@
+/* i2c_bus.h
+ *
+ * Shared I2C bus manager. Owns the single /dev/i2c-N fd used by every
+ * device on the bus and issues I2C_RDWR transactions with the target
+ * address in each message (no I2C_SLAVE pinning). Transactions are
+ * serialized, and high priority ones (sensor reads) go ahead of any
+ * waiting low priority ones (display chunks). Callers keep their
+ * transactions short so a sensor read never waits behind a whole frame.
+ */
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <linux/i2c.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef I2C_BUS_DEV
+#define I2C_BUS_DEV "/dev/i2c-1"
+#endif
+
+enum i2c_bus_prio {
+    I2C_BUS_PRIO_LOW = 0,       /* bulk transfers, e.g. display data */
+    I2C_BUS_PRIO_HIGH           /* time-critical, e.g. INA260 reads */
+};
+
+/* Open the bus. Reference counted: each successful open needs a close.
+ * Opening again with a different path fails.
+ * Returns 0 on success, -1 on error.
+ */
+int i2c_bus_open(const char *path);
+void i2c_bus_close(void);
+
+/* Run one combined transaction (repeated starts between messages).
+ * Returns 0 on success, -1 on error with errno set.
+ */
+int i2c_bus_xfer(struct i2c_msg *msgs, int nmsgs, enum i2c_bus_prio prio);
+
+/* Single write message to addr. Returns 0 on success, -1 on error. */
+int i2c_bus_write(uint8_t addr, const uint8_t *buf, size_t len, enum i2c_bus_prio prio);
+
+/* ---- Instrumentation ----
+ * Every transaction is timed and counted against the address of its
+ * first message. Latency is the ioctl time (bus time); wait is the time
+ * spent queued behind other transactions.
+ */
+
+/* Latency histogram: bucket b counts transactions under 2^b us,
+ * the last bucket everything slower.
+ */
+#define I2C_BUS_HIST_BUCKETS 16
+
+struct i2c_bus_stats {
+    unsigned long xfers;
+    unsigned long bytes;            /* payload bytes, both directions */
+    unsigned long nack;             /* ENXIO / EREMOTEIO: no ACK from the device */
+    unsigned long eio;
+    unsigned long timeout;          /* ETIMEDOUT */
+    unsigned long other_err;
+    uint64_t busy_ns;               /* total ioctl time */
+    uint64_t max_ns;
+    uint64_t wait_ns;               /* total time queued for the bus */
+    unsigned long hist[I2C_BUS_HIST_BUCKETS];
+};
+
+/* Copy the counters for one 7-bit address. Returns 0, or -1 if the
+ * address has never been used.
+ */
+int i2c_bus_get_stats(uint8_t addr, struct i2c_bus_stats *out);
+
+/* Fill addrs with up to max addresses that have seen traffic.
+ * Returns how many were written.
+ */
+int i2c_bus_active_addrs(uint8_t *addrs, int max);
+
+/* Upper bound in microseconds of the bucket holding the given
+ * percentile (0..100) of transactions.
+ */
+unsigned long i2c_bus_percentile_us(const struct i2c_bus_stats *st, int pct);
+
+/* Percent of wall time the bus was busy since it was opened. */
+double i2c_bus_utilization(void);
+
+/* Print a per-address report. */
+void i2c_bus_stats_dump(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* I2C_BUS_H */
@@ -1,58 +1,299 @@
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
+#include "i2c_bus.h"
 #include "ina260.h"
 
-static int read_register(int i2c_fd, uint8_t reg, int16_t *value) {
+// Registers are accessed through the shared bus manager with the device
+// address in every message, so any number of INA260s share the bus, and
+// the pointer write + data read can't be split by another thread.
+// Sensor reads run at high priority, ahead of queued display chunks.
+static int read_register(struct ina260_dev *dev, uint8_t reg, int16_t *value) {
     uint8_t buf[2];
-    if (write(i2c_fd, &reg, 1) != 1)
-        return -1;
-    if (read(i2c_fd, buf, 2) != 2)
-        return -2;
+    struct i2c_msg msgs[2] = {
+        { .addr = dev->addr, .flags = 0,        .len = 1, .buf = &reg },
+        { .addr = dev->addr, .flags = I2C_M_RD, .len = 2, .buf = buf  },
+    };
+
+    if (i2c_bus_xfer(msgs, 2, I2C_BUS_PRIO_HIGH) != 0)
+        return INA260_ERR_XFER;
 
     *value = (buf[0] << 8) | buf[1];
-    return 0;
+    return INA260_OK;
+}
+
+static int write_register(struct ina260_dev *dev, uint8_t reg, uint16_t value) {
+    uint8_t buf[3] = { reg, value >> 8, value & 0xFF };
+
+    if (i2c_bus_write(dev->addr, buf, 3, I2C_BUS_PRIO_HIGH) != 0)
+        return INA260_ERR_WRITE;
+    return INA260_OK;
 }
 
 #define DEV_ID 0x5449
 
-int ina260_init(int i2c_fd) {
+int ina260_init(struct ina260_dev *dev) {
     int16_t raw=0;
     int rc=0;
 
     // No specific init needed for default config
-    if ((rc=read_register(i2c_fd, INA260_REG_MANUF_ID, &raw)) == 0) {
+    if ((rc=read_register(dev, INA260_REG_MANUF_ID, &raw)) == 0) {
         if (raw == DEV_ID) {
-            printf("ina260 ID 0x%04X Match 0x%04X\n", raw, DEV_ID);
+            printf("ina260 %s@0x%02X ID 0x%04X Match 0x%04X\n", dev->name, dev->addr, raw, DEV_ID);
             return 0;
         } else{
-            printf("ina260 ID 0x%04X error! should be: 0x%04X\n", raw, DEV_ID);
+            printf("ina260 %s@0x%02X ID 0x%04X error! should be: 0x%04X\n",
+                   dev->name, dev->addr, raw, DEV_ID);
             return 1;
         }
     }  
-    printf("%s(%d) reg[0x%02X] read ERROR! %d\n", __func__,__LINE__,INA260_REG_MANUF_ID, rc);
+    printf("%s(%d) %s@0x%02X reg[0x%02X] read ERROR! %d\n", __func__,__LINE__,
+           dev->name, dev->addr, INA260_REG_MANUF_ID, rc);
     return 2;
 }
 
-float ina260_read_current_mA(int i2c_fd) {
-    int16_t raw;
-    if (read_register(i2c_fd, INA260_REG_CURRENT, &raw) != 0)
+int ina260_open(struct ina260_dev *dev, uint8_t addr, const char *name) {
+    memset(dev, 0, sizeof(*dev));
+    dev->addr = addr;
+    dev->name = name ? name : "ina260";
+    ina260_preset_config(INA260_PRESET_DEFAULT, &dev->cfg);    // power-on state
+    return ina260_init(dev);
+}
+
+float ina260_read_current_mA(struct ina260_dev *dev) {
+    int32_t raw;
+    if (ina260_read_current_raw(dev, &raw) != INA260_OK)
         return -9999.0;
-    return raw * 1.25; // 1.25 mA per bit
+    return ina260_raw_to_mA(raw); // 1.25 mA per bit
 }
 
-float ina260_read_voltage_mV(int i2c_fd) {
-    int16_t raw;
-    if (read_register(i2c_fd, INA260_REG_VOLTAGE, &raw) != 0)
+float ina260_read_voltage_mV(struct ina260_dev *dev) {
+    int32_t raw;
+    if (ina260_read_voltage_raw(dev, &raw) != INA260_OK)
         return -9999.0;
-    return raw * 1.25; // 1.25 mV per bit
+    return ina260_raw_to_mV(raw); // 1.25 mV per bit
 }
 
-float ina260_read_power_mW(int i2c_fd) {
-    int16_t raw;
-    if (read_register(i2c_fd, INA260_REG_POWER, &raw) != 0)
+float ina260_read_power_mW(struct ina260_dev *dev) {
+    int32_t raw;
+    if (ina260_read_power_raw(dev, &raw) != INA260_OK)
         return -9999.0;
-    return raw * 10.0; // 10 mW per bit
+    return ina260_raw_to_mW(raw); // 10 mW per bit
+}
+
+// read_register() already returns INA260_ERR_XFER on failure; write_register()
+// returns INA260_ERR_WRITE
+int ina260_read_current_raw(struct ina260_dev *dev, int32_t *raw) {
+    int16_t v;
+    int rc = read_register(dev, INA260_REG_CURRENT, &v);
+    if (rc == INA260_OK)
+        *raw = v;               // two's complement, negative when charging
+    return rc;
+}
+
+int ina260_read_voltage_raw(struct ina260_dev *dev, int32_t *raw) {
+    int16_t v;
+    int rc = read_register(dev, INA260_REG_VOLTAGE, &v);
+    if (rc == INA260_OK)
+        *raw = (uint16_t)v;
+    return rc;
+}
+
+int ina260_read_power_raw(struct ina260_dev *dev, int32_t *raw) {
+    int16_t v;
+    int rc = read_register(dev, INA260_REG_POWER, &v);
+    if (rc == INA260_OK)
+        *raw = (uint16_t)v;     // unsigned, can exceed 0x7FFF above 327 W
+    return rc;
+}
+
+// Set once the adapter has refused a combined transfer with more than one
+// read; from then on read_all() issues one write+read pair per register.
+static int split_reads = 0;
+
+// Read current, voltage and power in one bus transaction where the adapter
+// allows it. Each register needs its own pointer write (the INA260 does not
+// auto-increment), so the transaction is three write/read pairs joined with
+// repeated starts. i2c-bcm2835 (Pi 0-4) takes only one read message, as the
+// last one, and fails that with EOPNOTSUPP; then fall back to three
+// transfers. The chip latches all three registers together at the end of
+// each conversion, so the values match either way.
+int ina260_read_all(struct ina260_dev *dev, struct ina260_sample *s) {
+    static const uint8_t regs[3] = {
+        INA260_REG_CURRENT, INA260_REG_VOLTAGE, INA260_REG_POWER
+    };
+    uint8_t buf[3][2];
+    struct i2c_msg msgs[6];
+    struct timespec t0, t1;
+
+    for (int i = 0; i < 3; i++) {
+        msgs[2 * i].addr      = dev->addr;
+        msgs[2 * i].flags     = 0;
+        msgs[2 * i].len       = 1;
+        msgs[2 * i].buf       = (uint8_t *)&regs[i];
+        msgs[2 * i + 1].addr  = dev->addr;
+        msgs[2 * i + 1].flags = I2C_M_RD;
+        msgs[2 * i + 1].len   = 2;
+        msgs[2 * i + 1].buf   = buf[i];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (!split_reads) {
+        if (i2c_bus_xfer(msgs, 6, I2C_BUS_PRIO_HIGH) != 0) {
+            if (errno != EOPNOTSUPP)
+                return INA260_ERR_XFER;
+            split_reads = 1;
+            printf("ina260: adapter allows one read per transfer, reading registers separately\n");
+        }
+    }
+    if (split_reads) {
+        for (int i = 0; i < 3; i++) {
+            if (i2c_bus_xfer(&msgs[2 * i], 2, I2C_BUS_PRIO_HIGH) != 0)
+                return INA260_ERR_XFER;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // Stamp the sample at the middle of the transfer
+    int64_t mid_ns = ((int64_t)t0.tv_sec * 1000000000LL + t0.tv_nsec +
+                      (int64_t)t1.tv_sec * 1000000000LL + t1.tv_nsec) / 2;
+    s->ts.tv_sec  = mid_ns / 1000000000LL;
+    s->ts.tv_nsec = mid_ns % 1000000000LL;
+
+    s->current_raw = (int16_t)((buf[0][0] << 8) | buf[0][1]);
+    s->voltage_raw = (uint16_t)((buf[1][0] << 8) | buf[1][1]);
+    s->power_raw   = (uint16_t)((buf[2][0] << 8) | buf[2][1]);
+    return INA260_OK;
+}
+
+static const unsigned int ct_us[8]  = { 140, 204, 332, 588, 1100, 2116, 4156, 8244 };
+static const unsigned int avg_n[8] = { 1, 4, 16, 64, 128, 256, 512, 1024 };
+
+static uint16_t config_word(const struct ina260_config *cfg) {
+    return INA260_CFG_FIXED |
+           ((cfg->avg & 7) << INA260_CFG_AVG_SHIFT) |
+           ((cfg->vbus_ct & 7) << INA260_CFG_VBUSCT_SHIFT) |
+           ((cfg->ish_ct & 7) << INA260_CFG_ISHCT_SHIFT) |
+           (cfg->mode & INA260_CFG_MODE_MASK);
+}
+
+void ina260_preset_config(enum ina260_preset preset, struct ina260_config *out) {
+    switch (preset) {
+    case INA260_PRESET_FAST_FAULT:
+        out->avg = INA260_AVG_1;
+        out->vbus_ct = INA260_CT_588US;
+        out->ish_ct = INA260_CT_588US;
+        break;
+    case INA260_PRESET_LOW_NOISE:
+        out->avg = INA260_AVG_64;
+        out->vbus_ct = INA260_CT_1100US;
+        out->ish_ct = INA260_CT_1100US;
+        break;
+    case INA260_PRESET_DEFAULT:
+    default:
+        out->avg = INA260_AVG_1;
+        out->vbus_ct = INA260_CT_1100US;
+        out->ish_ct = INA260_CT_1100US;
+        break;
+    }
+    out->mode = INA260_MODE_CONT_BOTH;
+}
+
+int ina260_configure(struct ina260_dev *dev, const struct ina260_config *cfg) {
+    uint16_t want = config_word(cfg);
+    int16_t raw = 0;
+
+    if (write_register(dev, INA260_REG_CONFIG, want) != 0)
+        return -1;
+    if (read_register(dev, INA260_REG_CONFIG, &raw) != 0)
+        return -1;
+    if (((uint16_t)raw & ~INA260_CFG_RST) != want) {
+        printf("ina260 %s CONFIG read back 0x%04X, wrote 0x%04X\n", dev->name, (uint16_t)raw, want);
+        return -2;
+    }
+    dev->cfg = *cfg;
+    return 0;
+}
+
+int ina260_configure_preset(struct ina260_dev *dev, enum ina260_preset preset) {
+    struct ina260_config cfg;
+    ina260_preset_config(preset, &cfg);
+    return ina260_configure(dev, &cfg);
+}
+
+int ina260_set_mode(struct ina260_dev *dev, enum ina260_mode mode) {
+    struct ina260_config cfg = dev->cfg;
+    cfg.mode = mode;
+    return ina260_configure(dev, &cfg);
+}
+
+int ina260_trigger(struct ina260_dev *dev) {
+    // Any write to CONFIG starts a new single-shot conversion in triggered mode
+    return write_register(dev, INA260_REG_CONFIG, config_word(&dev->cfg));
+}
+
+int ina260_read_mask_enable(struct ina260_dev *dev, uint16_t *value) {
+    int16_t raw;
+    if (read_register(dev, INA260_REG_MASK_EN, &raw) != 0)
+        return -1;
+    *value = (uint16_t)raw;
+    return 0;
+}
+
+int ina260_write_mask_enable(struct ina260_dev *dev, uint16_t value) {
+    return write_register(dev, INA260_REG_MASK_EN, value);
+}
+
+int ina260_set_alert(struct ina260_dev *dev, uint16_t function, float limit) {
+    float lsb;
+
+    switch (function) {
+    case INA260_ME_OCL:
+    case INA260_ME_UCL:
+        lsb = 1.25;     // mA per bit, same as the current register
+        break;
+    case INA260_ME_BOL:
+    case INA260_ME_BUL:
+        lsb = 1.25;     // mV per bit, same as the voltage register
+        break;
+    case INA260_ME_POL:
+        lsb = 10.0;     // mW per bit, same as the power register
+        break;
+    default:
+        return -1;
+    }
+
+    // Set the limit before enabling the function so ALERT never fires on a stale limit
+    if (write_register(dev, INA260_REG_ALERT, (uint16_t)(int16_t)(limit / lsb)) != 0)
+        return -1;
+    if (write_register(dev, INA260_REG_MASK_EN, function) != 0)
+        return -1;
+    return 0;
+}
+
+int ina260_conversion_ready(struct ina260_dev *dev) {
+    uint16_t me;
+    if (ina260_read_mask_enable(dev, &me) != 0)
+        return -1;
+    return (me & INA260_ME_CVRF) ? 1 : 0;
+}
+
+unsigned int ina260_conversion_period_us(const struct ina260_config *cfg) {
+    unsigned int t;
+
+    switch (cfg->mode) {
+    case INA260_MODE_TRIG_CURRENT:
+    case INA260_MODE_CONT_CURRENT:
+        t = ct_us[cfg->ish_ct & 7];
+        break;
+    case INA260_MODE_TRIG_VOLTAGE:
+    case INA260_MODE_CONT_VOLTAGE:
+        t = ct_us[cfg->vbus_ct & 7];
+        break;
+    default:
+        t = ct_us[cfg->ish_ct & 7] + ct_us[cfg->vbus_ct & 7];
+        break;
+    }
+    return t * avg_n[cfg->avg & 7];
 }
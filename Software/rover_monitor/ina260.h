@@ -2,8 +2,9 @@
 #define INA260_H
 
 #include <stdint.h>
+#include <time.h>
 
-// 0x40 overlaps pca9685 addr, soldered sharp teeth to move over addr from 0x40 to 0x45
+// Main battery sensor. 0x40 overlaps pca9685 addr, soldered sharp teeth to move over addr from 0x40 to 0x45
 #define INA260_ADDRESS       0x45 //  0x40
 
 #define INA260_REG_CONFIG    0x00
@@ -14,9 +15,147 @@
 #define INA260_REG_ALERT     0x07
 #define INA260_REG_MANUF_ID  0xFE
 
-int ina260_init(int i2c_fd);
-float ina260_read_current_mA(int i2c_fd);
-float ina260_read_voltage_mV(int i2c_fd);
-float ina260_read_power_mW(int i2c_fd);
+// CONFIG register fields
+#define INA260_CFG_RST       0x8000
+#define INA260_CFG_FIXED     0x6000     // bits 14:12 read back as 110
+#define INA260_CFG_AVG_SHIFT      9
+#define INA260_CFG_VBUSCT_SHIFT   6
+#define INA260_CFG_ISHCT_SHIFT    3
+#define INA260_CFG_MODE_MASK 0x0007
+
+// MASK/ENABLE register bits
+#define INA260_ME_OCL        0x8000     // over current limit
+#define INA260_ME_UCL        0x4000     // under current limit
+#define INA260_ME_BOL        0x2000     // bus voltage over limit
+#define INA260_ME_BUL        0x1000     // bus voltage under limit
+#define INA260_ME_POL        0x0800     // power over limit
+#define INA260_ME_CNVR       0x0400     // assert ALERT on conversion ready
+#define INA260_ME_AFF        0x0010     // alert function flag
+#define INA260_ME_CVRF       0x0008     // conversion ready flag, cleared by reading MASK/ENABLE
+#define INA260_ME_OVF        0x0004     // math overflow
+#define INA260_ME_APOL       0x0002     // ALERT active high
+#define INA260_ME_LEN        0x0001     // latch ALERT until MASK/ENABLE is read
+
+// Number of samples averaged per result
+enum ina260_avg {
+    INA260_AVG_1 = 0, INA260_AVG_4, INA260_AVG_16, INA260_AVG_64,
+    INA260_AVG_128, INA260_AVG_256, INA260_AVG_512, INA260_AVG_1024
+};
+
+// Bus voltage / shunt current conversion time
+enum ina260_ct {
+    INA260_CT_140US = 0, INA260_CT_204US, INA260_CT_332US, INA260_CT_588US,
+    INA260_CT_1100US, INA260_CT_2116US, INA260_CT_4156US, INA260_CT_8244US
+};
+
+enum ina260_mode {
+    INA260_MODE_SHUTDOWN     = 0,
+    INA260_MODE_TRIG_CURRENT = 1,
+    INA260_MODE_TRIG_VOLTAGE = 2,
+    INA260_MODE_TRIG_BOTH    = 3,
+    INA260_MODE_CONT_CURRENT = 5,
+    INA260_MODE_CONT_VOLTAGE = 6,
+    INA260_MODE_CONT_BOTH    = 7
+};
+
+struct ina260_config {
+    enum ina260_avg  avg;
+    enum ina260_ct   vbus_ct;
+    enum ina260_ct   ish_ct;
+    enum ina260_mode mode;
+};
+
+enum ina260_preset {
+    INA260_PRESET_DEFAULT = 0,  // power-on: 1.1 ms + 1.1 ms, no averaging
+    INA260_PRESET_FAST_FAULT,   // 588 us + 588 us, no averaging: ~1.2 ms per result
+    INA260_PRESET_LOW_NOISE     // 1.1 ms + 1.1 ms, 64x averaging: ~141 ms per result
+};
+
+// Register LSB sizes. Raw counts are scaled only for display/logging.
+#define INA260_CURRENT_uA_PER_LSB  1250
+#define INA260_VOLTAGE_uV_PER_LSB  1250
+#define INA260_POWER_mW_PER_LSB      10
+
+// Convert a limit in mA / mV to raw counts, for integer threshold compares
+#define INA260_mA_TO_RAW(ma)  ((int32_t)((ma) * 1000 / INA260_CURRENT_uA_PER_LSB))
+#define INA260_mV_TO_RAW(mv)  ((int32_t)((mv) * 1000 / INA260_VOLTAGE_uV_PER_LSB))
+
+// Status codes for the integer API
+enum ina260_status {
+    INA260_OK        =  0,
+    INA260_ERR_WRITE = -1,      // register write failed (NACK / bus error)
+    INA260_ERR_XFER  = -3       // pointer write + read transfer failed
+};
+
+// One coherent current/voltage/power sample, read in a single bus
+// transaction. ts is CLOCK_MONOTONIC at the middle of the transfer.
+// Values are raw register counts (current signed, voltage and power unsigned).
+struct ina260_sample {
+    struct timespec ts;
+    int32_t current_raw;
+    int32_t voltage_raw;
+    int32_t power_raw;
+};
+
+static inline float ina260_raw_to_mA(int32_t raw) { return raw * 1.25f; }
+static inline float ina260_raw_to_mV(int32_t raw) { return raw * 1.25f; }
+static inline float ina260_raw_to_mW(int32_t raw) { return raw * 10.0f; }
+
+// One INA260 on the shared bus (see i2c_bus.h, which must be open).
+// Each transaction carries the device's own address.
+struct ina260_dev {
+    uint8_t addr;
+    const char *name;
+    struct ina260_config cfg;   // last config written (power-on default after open)
+};
+
+// Fill in dev and check the manufacturer ID. Returns 0 on success,
+// 1 on ID mismatch, 2 on I/O error.
+int ina260_open(struct ina260_dev *dev, uint8_t addr, const char *name);
+int ina260_init(struct ina260_dev *dev);
+
+// Float API: returns -9999.0 on error.
+float ina260_read_current_mA(struct ina260_dev *dev);
+float ina260_read_voltage_mV(struct ina260_dev *dev);
+float ina260_read_power_mW(struct ina260_dev *dev);
+
+// Integer API: raw LSB counts, returns an enum ina260_status.
+int ina260_read_current_raw(struct ina260_dev *dev, int32_t *raw);
+int ina260_read_voltage_raw(struct ina260_dev *dev, int32_t *raw);
+int ina260_read_power_raw(struct ina260_dev *dev, int32_t *raw);
+int ina260_read_all(struct ina260_dev *dev, struct ina260_sample *s);
+
+// Write CONFIG, read it back and remember it in dev->cfg. Returns 0 on
+// success, -1 on I/O error, -2 if the read-back value does not match.
+int ina260_configure(struct ina260_dev *dev, const struct ina260_config *cfg);
+int ina260_configure_preset(struct ina260_dev *dev, enum ina260_preset preset);
+void ina260_preset_config(enum ina260_preset preset, struct ina260_config *out);
+
+// Change only the operating mode (e.g. INA260_MODE_SHUTDOWN to save power).
+int ina260_set_mode(struct ina260_dev *dev, enum ina260_mode mode);
+
+// Start one conversion in a triggered mode by re-writing CONFIG.
+int ina260_trigger(struct ina260_dev *dev);
+
+// MASK/ENABLE access. Reading clears CVRF (and AFF in latch mode).
+int ina260_read_mask_enable(struct ina260_dev *dev, uint16_t *value);
+int ina260_write_mask_enable(struct ina260_dev *dev, uint16_t value);
+
+// Program ALERT (active low, transparent) to assert while one limit
+// condition holds. function is one of INA260_ME_OCL, _UCL, _BOL, _BUL or
+// _POL; limit is in that quantity's units (mA, mV or mW). The INA260 can
+// only watch one limit at a time. Returns 0 on success, -1 on error.
+int ina260_set_alert(struct ina260_dev *dev, uint16_t function, float limit);
+
+// Poll the conversion ready flag. Returns 1 if a new result is ready
+// (and clears the flag), 0 if not, -1 on I/O error.
+int ina260_conversion_ready(struct ina260_dev *dev);
+
+// Time in microseconds between new results for this config.
+unsigned int ina260_conversion_period_us(const struct ina260_config *cfg);
+
+static inline int ina260_mode_is_triggered(enum ina260_mode m) {
+    return m >= INA260_MODE_TRIG_CURRENT && m <= INA260_MODE_TRIG_BOTH;
+}
 
 #endif
@@ -0,0 +1,319 @@
+/* ina260_acq.c
+ *
+ * INA260 acquisition thread. Every sweep calls ina260_read_all() on each
+ * device and pushes the result into that device's ring. In timed mode
+ * sweeps run once per period on a clock_nanosleep(TIMER_ABSTIME)
+ * schedule, so the rate does not drift with read latency. In the
+ * conversion-ready modes a sweep starts when the first device's CVRF
+ * flag is set (polled, or routed to its ALERT pin and watched with
+ * libgpiod) so every conversion is read exactly once.
+ */
+
+#include "ina260_acq.h"
+
+#include <gpiod.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef INA260_ACQ_GPIOCHIP_PATH
+#define INA260_ACQ_GPIOCHIP_PATH "/dev/gpiochip0"
+#endif
+
+/* Shortest re-poll interval after CVRF was found clear */
+#ifndef INA260_ACQ_MIN_POLL_US
+#define INA260_ACQ_MIN_POLL_US 50
+#endif
+
+/* Longest ALERT wait, so ina260_acq_stop() never hangs */
+#ifndef INA260_ACQ_ALERT_WAIT_MS
+#define INA260_ACQ_ALERT_WAIT_MS 200
+#endif
+
+static struct ina260_dev *g_dev[INA260_ACQ_MAX_DEVS];
+static struct sample_ring g_ring[INA260_ACQ_MAX_DEVS];
+static atomic_ulong g_errors[INA260_ACQ_MAX_DEVS];
+static int g_ndev = 0;
+static pthread_t g_thread;
+static int g_started = 0;
+static long g_period_ns = 0;
+static long g_conv_ns = 0;
+static enum ina260_acq_mode g_mode;
+static struct gpiod_chip *g_chip = NULL;
+static struct gpiod_line *g_alert = NULL;
+static atomic_int g_stop = 0;
+
+static void _ts_add_ns(struct timespec *ts, long ns) {
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+static int _ts_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void _sleep_until(const struct timespec *t) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, t, NULL) == EINTR)
+        ;
+}
+
+/* Read one result from every device into its ring and, in triggered
+ * mode, start each device's next conversion.
+ */
+static void _sweep(void) {
+    for (int i = 0; i < g_ndev; i++) {
+        struct ina260_dev *dev = g_dev[i];
+        struct ina260_sample s;
+
+        if (ina260_read_all(dev, &s) == INA260_OK)
+            sample_ring_push(&g_ring[i], &s);
+        else
+            atomic_fetch_add(&g_errors[i], 1);
+
+        if (ina260_mode_is_triggered(dev->cfg.mode) && ina260_trigger(dev) != INA260_OK)
+            atomic_fetch_add(&g_errors[i], 1);
+    }
+}
+
+static void _run_timed(void) {
+    struct timespec next, now;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!atomic_load(&g_stop)) {
+        _sweep();
+
+        _ts_add_ns(&next, g_period_ns);
+
+        /* If we overran (bus stall), resync rather than bursting to catch up */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (_ts_before(&next, &now))
+            next = now;
+        _sleep_until(&next);
+    }
+}
+
+/* Sleep until a poll interval before the conversion should be done, then
+ * poll CVRF. The next wake is anchored to the poll that saw CVRF, less the
+ * margin, so wake-up latency can't accumulate into lag: a device clock that
+ * runs ahead makes the early poll find CVRF set and slides the schedule
+ * earlier. Each result is read exactly once.
+ */
+static void _run_cvrf_poll(void) {
+    long poll_ns = g_conv_ns / 8;
+    if (poll_ns < INA260_ACQ_MIN_POLL_US * 1000L)
+        poll_ns = INA260_ACQ_MIN_POLL_US * 1000L;
+
+    long lead_ns = g_period_ns - poll_ns;
+    if (lead_ns < poll_ns)
+        lead_ns = poll_ns;
+
+    struct timespec next, now;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    _ts_add_ns(&next, g_conv_ns);
+
+    while (!atomic_load(&g_stop)) {
+        _sleep_until(&next);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        int rdy = ina260_conversion_ready(g_dev[0]);
+        if (rdy < 0) {
+            atomic_fetch_add(&g_errors[0], 1);
+            next = now;
+            _ts_add_ns(&next, g_period_ns);
+            continue;
+        }
+        if (rdy == 0) {
+            next = now;
+            _ts_add_ns(&next, poll_ns);
+            continue;
+        }
+
+        /* The conversion finished at or just before now */
+        _sweep();
+        next = now;
+        _ts_add_ns(&next, lead_ns);
+    }
+}
+
+/* ALERT is open-drain, active low, asserted while CVRF is set. Reading
+ * MASK/ENABLE clears CVRF and releases the pin for the next conversion.
+ */
+static void _run_cvrf_alert(void) {
+    uint16_t me;
+
+    /* Clear anything already pending so the first edge is a fresh one */
+    (void)ina260_read_mask_enable(g_dev[0], &me);
+
+    while (!atomic_load(&g_stop)) {
+        struct timespec timeout = {
+            .tv_sec = 0, .tv_nsec = INA260_ACQ_ALERT_WAIT_MS * 1000L * 1000L
+        };
+        int w = gpiod_line_event_wait(g_alert, &timeout);
+        if (w < 0) {
+            if (atomic_load(&g_stop))
+                break;
+            fprintf(stderr, "ina260_acq: ALERT event_wait error: %s\n", strerror(errno));
+            break;
+        }
+        if (w > 0) {
+            struct gpiod_line_event ev;
+            if (gpiod_line_event_read(g_alert, &ev) < 0) {
+                atomic_fetch_add(&g_errors[0], 1);
+                continue;
+            }
+        }
+
+        /* On timeout this re-arms ALERT in case an edge was missed */
+        if (ina260_read_mask_enable(g_dev[0], &me) != 0) {
+            atomic_fetch_add(&g_errors[0], 1);
+            continue;
+        }
+        if (me & INA260_ME_CVRF)
+            _sweep();
+    }
+}
+
+static void *_acq_thread(void *arg) {
+    (void)arg;
+
+    switch (g_mode) {
+    case INA260_ACQ_CVRF_POLL:
+        _run_cvrf_poll();
+        break;
+    case INA260_ACQ_CVRF_ALERT:
+        _run_cvrf_alert();
+        break;
+    case INA260_ACQ_TIMED:
+    default:
+        _run_timed();
+        break;
+    }
+    return NULL;
+}
+
+static void _release_alert(void) {
+    if (g_alert) {
+        gpiod_line_release(g_alert);
+        g_alert = NULL;
+    }
+    if (g_chip) {
+        gpiod_chip_close(g_chip);
+        g_chip = NULL;
+    }
+}
+
+static int _setup_alert(int alert_pin) {
+    g_chip = gpiod_chip_open(INA260_ACQ_GPIOCHIP_PATH);
+    if (!g_chip) {
+        fprintf(stderr, "ina260_acq: gpiod_chip_open: %s\n", strerror(errno));
+        return -1;
+    }
+    g_alert = gpiod_chip_get_line(g_chip, alert_pin);
+    if (!g_alert) {
+        fprintf(stderr, "ina260_acq: gpiod_chip_get_line failed for GPIO %d\n", alert_pin);
+        _release_alert();
+        return -1;
+    }
+    /* ALERT is open drain; the internal pull-up keeps it high when idle */
+    if (gpiod_line_request_falling_edge_events_flags(g_alert, "ina260_alert",
+                                                     GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP) < 0) {
+        fprintf(stderr, "ina260_acq: request_falling_edge_events failed for GPIO %d: %s\n",
+                alert_pin, strerror(errno));
+        g_alert = NULL;
+        _release_alert();
+        return -1;
+    }
+    if (ina260_write_mask_enable(g_dev[0], INA260_ME_CNVR) != 0) {
+        fprintf(stderr, "ina260_acq: MASK/ENABLE write failed\n");
+        _release_alert();
+        return -1;
+    }
+    return 0;
+}
+
+int ina260_acq_start(struct ina260_dev *const *devs, int ndev,
+                     enum ina260_acq_mode mode, unsigned int period_us, int alert_pin) {
+    if (g_started) {
+        fprintf(stderr, "ina260_acq_start: already running\n");
+        return -1;
+    }
+    if (ndev < 1 || ndev > INA260_ACQ_MAX_DEVS) {
+        fprintf(stderr, "ina260_acq_start: %d devices, 1..%d supported\n", ndev,
+                INA260_ACQ_MAX_DEVS);
+        return -1;
+    }
+
+    /* Sweep no faster than the slowest device converts */
+    unsigned int conv_us = 0;
+    for (int i = 0; i < ndev; i++) {
+        if (devs[i]->cfg.mode == INA260_MODE_SHUTDOWN) {
+            fprintf(stderr, "ina260_acq_start: %s is in shutdown mode\n", devs[i]->name);
+            return -1;
+        }
+        unsigned int t = ina260_conversion_period_us(&devs[i]->cfg);
+        if (t > conv_us)
+            conv_us = t;
+    }
+    if (period_us < conv_us)
+        period_us = conv_us;
+
+    g_ndev = ndev;
+    for (int i = 0; i < ndev; i++) {
+        g_dev[i] = devs[i];
+        atomic_store(&g_errors[i], 0);
+        sample_ring_init(&g_ring[i]);
+    }
+    g_mode = mode;
+    g_conv_ns = (long)conv_us * 1000L;
+    g_period_ns = (long)period_us * 1000L;
+    atomic_store(&g_stop, 0);
+
+    if (mode == INA260_ACQ_CVRF_ALERT && _setup_alert(alert_pin) != 0)
+        return -1;
+
+    for (int i = 0; i < ndev; i++) {
+        if (ina260_mode_is_triggered(devs[i]->cfg.mode) && ina260_trigger(devs[i]) != INA260_OK) {
+            fprintf(stderr, "ina260_acq_start: %s trigger failed\n", devs[i]->name);
+            _release_alert();
+            return -1;
+        }
+    }
+
+    int rc = pthread_create(&g_thread, NULL, _acq_thread, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "ina260_acq_start: pthread_create: %s\n", strerror(rc));
+        _release_alert();
+        return -1;
+    }
+    g_started = 1;
+    return 0;
+}
+
+int ina260_acq_stop(void) {
+    if (!g_started)
+        return 0;
+    atomic_store(&g_stop, 1);
+    pthread_join(g_thread, NULL);
+    g_started = 0;
+
+    if (g_mode == INA260_ACQ_CVRF_ALERT) {
+        (void)ina260_write_mask_enable(g_dev[0], 0);
+        _release_alert();
+    }
+    return 0;
+}
+
+struct sample_ring *ina260_acq_ring(int idx) {
+    return &g_ring[idx];
+}
+
+unsigned long ina260_acq_errors(int idx) {
+    return atomic_load(&g_errors[idx]);
+}
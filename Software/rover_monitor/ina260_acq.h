@@ -0,0 +1,55 @@
+/* ina260_acq.h
+ *
+ * High-rate INA260 acquisition thread. Samples the sensor and publishes
+ * every sample to a lock-free ring, so the display, fault logic and
+ * logging never touch the I2C bus for battery readings.
+ */
+
+#ifndef INA260_ACQ_H
+#define INA260_ACQ_H
+
+#include "sample_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef INA260_ACQ_MAX_DEVS
+#define INA260_ACQ_MAX_DEVS 4
+#endif
+
+enum ina260_acq_mode {
+    INA260_ACQ_TIMED = 0,       /* read blindly every period */
+    INA260_ACQ_CVRF_POLL,       /* poll devs[0]'s conversion ready flag, read each result once */
+    INA260_ACQ_CVRF_ALERT       /* devs[0]'s conversion ready routed to ALERT, watched as a GPIO edge */
+};
+
+/* Start the acquisition thread on ndev opened, configured INA260s. Each
+ * sweep reads every device once; devs[0] paces the sweeps in the
+ * conversion-ready modes, so all devices should use the same config.
+ * period_us is clamped to the slowest device's conversion period, since
+ * sampling faster only re-reads the same result; 0 means "one sweep per
+ * conversion". In a triggered mode the thread starts each conversion
+ * itself.
+ * alert_pin is the BCM GPIO wired to devs[0]'s ALERT output (requested
+ * with a pull-up); it is only used in INA260_ACQ_CVRF_ALERT mode, which
+ * sweeps on every conversion and ignores period_us.
+ * The devices must outlive the thread. Returns 0 on success, -1 on error.
+ */
+int ina260_acq_start(struct ina260_dev *const *devs, int ndev,
+                     enum ina260_acq_mode mode, unsigned int period_us, int alert_pin);
+
+/* Stop and join the acquisition thread. Safe to call if never started. */
+int ina260_acq_stop(void);
+
+/* Ring for devs[idx]. Valid after ina260_acq_start(). */
+struct sample_ring *ina260_acq_ring(int idx);
+
+/* Number of failed reads of devs[idx] since start. */
+unsigned long ina260_acq_errors(int idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INA260_ACQ_H */
@@ -0,0 +1,131 @@
+/* ina260_alert.c
+ *
+ * INA260 ALERT line watcher, same libgpiod v1.6.3 pattern as buttons.c:
+ * one thread blocked in gpiod_line_event_wait() with a finite timeout so
+ * shutdown never hangs.
+ */
+
+#include "ina260_alert.h"
+
+#include <gpiod.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// ---------- Configuration ----------
+#ifndef INA260_ALERT_GPIOCHIP_PATH
+#define INA260_ALERT_GPIOCHIP_PATH "/dev/gpiochip0"
+#endif
+// -----------------------------------
+
+static struct gpiod_chip *g_chip = NULL;
+static struct gpiod_line *g_line = NULL;
+static pthread_t g_thread;
+static int g_thread_started = 0;
+static ina260_alert_cb_t g_cb = NULL;
+static atomic_int g_asserted = 0;
+static volatile int g_stop = 0;
+
+static void _report(int asserted) {
+    if (atomic_exchange(&g_asserted, asserted) == asserted)
+        return;     // no change
+    if (g_cb)
+        g_cb(asserted);
+}
+
+static void *_alert_thread(void *arg) {
+    (void)arg;
+
+    while (!g_stop) {
+        struct timespec timeout = { .tv_sec = 0, .tv_nsec = 200 * 1000 * 1000 }; // 200ms
+        int w = gpiod_line_event_wait(g_line, &timeout);
+        if (w < 0) {
+            if (g_stop) break;
+            fprintf(stderr, "ALERT event_wait error: %s\n", strerror(errno));
+            break;
+        }
+        if (w == 0) continue; // timeout, loop to check g_stop
+
+        struct gpiod_line_event ev;
+        if (gpiod_line_event_read(g_line, &ev) < 0) {
+            if (g_stop) break;
+            fprintf(stderr, "ALERT event_read error: %s\n", strerror(errno));
+            continue;
+        }
+
+        /* Active low: falling = limit crossed, rising = condition cleared */
+        _report(ev.event_type == GPIOD_LINE_EVENT_FALLING_EDGE);
+    }
+    return NULL;
+}
+
+static void _release(void) {
+    if (g_line) {
+        gpiod_line_release(g_line);
+        g_line = NULL;
+    }
+    if (g_chip) {
+        gpiod_chip_close(g_chip);
+        g_chip = NULL;
+    }
+}
+
+int ina260_alert_init(int pin_num, ina260_alert_cb_t cb) {
+    if (g_thread_started) {
+        fprintf(stderr, "ina260_alert_init: already initialized\n");
+        return -1;
+    }
+
+    g_stop = 0;
+    g_cb = cb;
+    atomic_store(&g_asserted, 0);
+
+    g_chip = gpiod_chip_open(INA260_ALERT_GPIOCHIP_PATH);
+    if (!g_chip) {
+        fprintf(stderr, "gpiod_chip_open: %s\n", strerror(errno));
+        return -1;
+    }
+    g_line = gpiod_chip_get_line(g_chip, pin_num);
+    if (!g_line) {
+        fprintf(stderr, "gpiod_chip_get_line failed for GPIO %d\n", pin_num);
+        _release();
+        return -1;
+    }
+    /* ALERT is open drain; the internal pull-up keeps it high when idle */
+    if (gpiod_line_request_both_edges_events_flags(g_line, "ina260_alert",
+                                                   GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP) < 0) {
+        fprintf(stderr, "request_both_edges_events failed for GPIO %d: %s\n",
+                pin_num, strerror(errno));
+        _release();
+        return -1;
+    }
+
+    /* A fault present before we started watching produces no edge */
+    if (gpiod_line_get_value(g_line) == 0)
+        _report(1);
+
+    if (pthread_create(&g_thread, NULL, _alert_thread, NULL) != 0) {
+        fprintf(stderr, "pthread_create failed for GPIO %d\n", pin_num);
+        _release();
+        return -1;
+    }
+    g_thread_started = 1;
+    return 0;
+}
+
+int ina260_alert_asserted(void) {
+    return atomic_load(&g_asserted);
+}
+
+int ina260_alert_shutdown(void) {
+    if (g_thread_started) {
+        g_stop = 1;
+        pthread_join(g_thread, NULL); // wakes within the event_wait timeout
+        g_thread_started = 0;
+    }
+    _release();
+    g_cb = NULL;
+    return 0;
+}
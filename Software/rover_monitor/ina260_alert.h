@@ -0,0 +1,38 @@
+/* ina260_alert.h
+ *
+ * Watches the INA260 ALERT output as a libgpiod edge event so limit
+ * faults are reported within a millisecond instead of on the next
+ * main loop tick. ALERT is open-drain, active low (the line is requested with a pull-up).
+ */
+
+#ifndef INA260_ALERT_H
+#define INA260_ALERT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called from the watcher thread: asserted=1 when ALERT goes low,
+ * asserted=0 when the condition clears and ALERT is released.
+ */
+typedef void (*ina260_alert_cb_t)(int asserted);
+
+/* Start watching BCM GPIO pin_num (gpiod offset). If ALERT is already
+ * asserted, cb is called with asserted=1 before this returns.
+ * Returns 0 on success, -1 on error.
+ */
+int ina260_alert_init(int pin_num, ina260_alert_cb_t cb);
+
+/* Current ALERT state as last reported to the callback. */
+int ina260_alert_asserted(void);
+
+/* Stop the thread, release the line, close the chip.
+ * Safe to call even if not initialized (returns 0).
+ */
+int ina260_alert_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INA260_ALERT_H */
@@ -0,0 +1,264 @@
+/* net_watch.c
+ *
+ * The socket stays blocking: dumps wait for their replies, notifications
+ * are read with MSG_DONTWAIT. If the kernel drops notifications
+ * (ENOBUFS) the tables are thrown away and dumped again.
+ */
+
+#include "net_watch.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct nw_if {
+    int index;
+    unsigned int flags;             /* IFF_* */
+};
+
+struct nw_addr {
+    int index;
+    struct in_addr addr;
+};
+
+static int g_fd = -1;
+static uint32_t g_seq = 0;
+static struct nw_if g_ifs[NET_WATCH_MAX_IFS];
+static int g_nifs = 0;
+static struct nw_addr g_addrs[NET_WATCH_MAX_ADDRS];  /* in kernel order */
+static int g_naddrs = 0;
+static char g_cur[INET_ADDRSTRLEN];                  /* last reported address */
+
+static struct nw_if *_find_if(int index) {
+    for (int i = 0; i < g_nifs; i++) {
+        if (g_ifs[i].index == index)
+            return &g_ifs[i];
+    }
+    return NULL;
+}
+
+static void _del_addrs(int index, const struct in_addr *addr) {
+    int n = 0;
+    for (int i = 0; i < g_naddrs; i++) {
+        if (g_addrs[i].index == index &&
+            (!addr || g_addrs[i].addr.s_addr == addr->s_addr))
+            continue;
+        g_addrs[n++] = g_addrs[i];
+    }
+    g_naddrs = n;
+}
+
+static void _link_msg(const struct nlmsghdr *nh) {
+    const struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    struct nw_if *e = _find_if(ifi->ifi_index);
+
+    if (nh->nlmsg_type == RTM_DELLINK) {
+        if (e) {
+            *e = g_ifs[--g_nifs];
+            _del_addrs(ifi->ifi_index, NULL);
+        }
+        return;
+    }
+    if (!e) {
+        if (g_nifs == NET_WATCH_MAX_IFS)
+            return;
+        e = &g_ifs[g_nifs++];
+        e->index = ifi->ifi_index;
+    }
+    e->flags = ifi->ifi_flags;
+}
+
+static void _addr_msg(const struct nlmsghdr *nh) {
+    const struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+    int len = IFA_PAYLOAD(nh);
+    const struct in_addr *local = NULL, *address = NULL;
+
+    if (ifa->ifa_family != AF_INET)
+        return;
+    for (const struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFA_LOCAL)
+            local = RTA_DATA(rta);
+        else if (rta->rta_type == IFA_ADDRESS)
+            address = RTA_DATA(rta);
+    }
+    // IFA_ADDRESS is the peer on point-to-point links; getifaddrs() uses
+    // IFA_LOCAL when present too
+    const struct in_addr *a = local ? local : address;
+    if (!a)
+        return;
+
+    _del_addrs(ifa->ifa_index, a);
+    if (nh->nlmsg_type == RTM_NEWADDR && g_naddrs < NET_WATCH_MAX_ADDRS) {
+        g_addrs[g_naddrs].index = ifa->ifa_index;
+        g_addrs[g_naddrs].addr = *a;
+        g_naddrs++;
+    }
+}
+
+/* Apply the messages in one datagram. Returns 1 at the end of a dump,
+ * -1 on a netlink error, else 0.
+ */
+static int _parse(const char *buf, ssize_t n) {
+    for (const struct nlmsghdr *nh = (const struct nlmsghdr *)buf; NLMSG_OK(nh, n);
+         nh = NLMSG_NEXT(nh, n)) {
+        switch (nh->nlmsg_type) {
+        case NLMSG_DONE:
+            return 1;
+        case NLMSG_ERROR: {
+            const struct nlmsgerr *err = NLMSG_DATA(nh);
+            if (err->error == 0)
+                break;              /* ACK */
+            errno = -err->error;
+            return -1;
+        }
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            _link_msg(nh);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            _addr_msg(nh);
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Request a dump and apply replies (and any notifications mixed in)
+ * until it is complete.
+ */
+static int _dump(uint16_t type) {
+    struct {
+        struct nlmsghdr nh;
+        struct rtgenmsg g;
+    } req = {
+        .nh = {
+            .nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg)),
+            .nlmsg_type = type,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = ++g_seq,
+        },
+        .g = { .rtgen_family = (type == RTM_GETADDR) ? AF_INET : AF_UNSPEC },
+    };
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+    if (send(g_fd, &req, req.nh.nlmsg_len, 0) < 0) {
+        perror("net_watch: send");
+        return -1;
+    }
+    for (;;) {
+        ssize_t n = recv(g_fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("net_watch: recv");
+            return -1;
+        }
+        int rc = _parse(buf, n);
+        if (rc < 0) {
+            perror("net_watch: dump");
+            return -1;
+        }
+        if (rc == 1)
+            return 0;
+    }
+}
+
+static int _resync(void) {
+    g_nifs = 0;
+    g_naddrs = 0;
+    if (_dump(RTM_GETLINK) < 0 || _dump(RTM_GETADDR) < 0)
+        return -1;
+    return 0;
+}
+
+int net_watch_open(void) {
+    struct sockaddr_nl sa = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR,
+    };
+
+    g_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (g_fd < 0) {
+        perror("net_watch: socket");
+        return -1;
+    }
+    if (bind(g_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        perror("net_watch: bind");
+        net_watch_close();
+        return -1;
+    }
+    if (_resync() < 0) {
+        net_watch_close();
+        return -1;
+    }
+    net_watch_ipv4(g_cur, sizeof(g_cur));
+    return g_fd;
+}
+
+int net_watch_process(void) {
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    char now[INET_ADDRSTRLEN];
+
+    if (g_fd < 0)
+        return -1;
+    for (;;) {
+        ssize_t n = recv(g_fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                /* Notifications were lost; start over from a dump */
+                if (_resync() < 0)
+                    return -1;
+                continue;
+            }
+            perror("net_watch: recv");
+            return -1;
+        }
+        _parse(buf, n);
+    }
+
+    net_watch_ipv4(now, sizeof(now));
+    if (strcmp(now, g_cur) == 0)
+        return 0;
+    strcpy(g_cur, now);
+    return 1;
+}
+
+int net_watch_ipv4(char *out, size_t outlen) {
+    const struct nw_addr *best = NULL;
+
+    for (int i = 0; i < g_naddrs; i++) {
+        const struct nw_if *e = _find_if(g_addrs[i].index);
+        if (!e || !(e->flags & IFF_UP) || (e->flags & IFF_LOOPBACK))
+            continue;
+        if (!best || g_addrs[i].index < best->index)
+            best = &g_addrs[i];
+    }
+    if (outlen)
+        out[0] = '\0';
+    if (!best || !inet_ntop(AF_INET, &best->addr, out, outlen))
+        return -1;
+    return 0;
+}
+
+void net_watch_close(void) {
+    if (g_fd >= 0) {
+        close(g_fd);
+        g_fd = -1;
+    }
+    g_nifs = 0;
+    g_naddrs = 0;
+}
@@ -0,0 +1,48 @@
+/* net_watch.h
+ *
+ * IPv4 address tracking over rtnetlink. One NETLINK_ROUTE socket is
+ * subscribed to link and IPv4 address changes; a table of interfaces
+ * and addresses is filled by an initial dump and then kept current from
+ * the kernel's notifications, so finding the IP never walks the system's
+ * interface list.
+ */
+
+#ifndef NET_WATCH_H
+#define NET_WATCH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NET_WATCH_MAX_IFS
+#define NET_WATCH_MAX_IFS   16
+#endif
+#ifndef NET_WATCH_MAX_ADDRS
+#define NET_WATCH_MAX_ADDRS 16
+#endif
+
+/* Open the socket and load the current links and addresses.
+ * Returns the fd to poll for POLLIN / EPOLLIN, or -1 on error.
+ */
+int net_watch_open(void);
+
+/* Apply every queued notification without blocking. Returns 1 if the
+ * address net_watch_ipv4() reports changed, 0 if not, -1 on error.
+ */
+int net_watch_process(void);
+
+/* The address getifaddrs() would list first: the first IPv4 address on
+ * the lowest numbered interface that is up and not loopback, as text.
+ * Returns 0, or -1 if there is none (out is then empty).
+ */
+int net_watch_ipv4(char *out, size_t outlen);
+
+void net_watch_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NET_WATCH_H */
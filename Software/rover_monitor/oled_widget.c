@@ -0,0 +1,226 @@
+/*
+ * oled_widget.c - retained text fields on the SSD1306 framebuffer
+ */
+
+#include "oled_widget.h"
+#include "ssd1306.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+void
+oled_field_init (struct oled_field *f, int x, int y, int w, int h)
+{
+  f->x = x;
+  f->y = y;
+  f->w = w;
+  f->h = h;
+  f->drawn = false;
+  f->text[0] = '\0';
+}
+
+int
+oled_field_set (struct oled_field *f, const char *text)
+{
+  if (f->drawn && strncmp (f->text, text, sizeof (f->text) - 1) == 0)
+    return 0;
+
+  // Clearing and drawing mark the box dirty for the next update
+  ssd1306_fill_rect (f->x, f->y, f->w, f->h, false);
+  snprintf (f->text, sizeof (f->text), "%s", text);
+  draw_text_prop (f->x, f->y, f->text);
+  f->drawn = true;
+  return 1;
+}
+
+int
+oled_field_setf (struct oled_field *f, const char *fmt, ...)
+{
+  char buf[OLED_FIELD_TEXT_MAX];
+  va_list ap;
+
+  va_start (ap, fmt);
+  vsnprintf (buf, sizeof (buf), fmt, ap);
+  va_end (ap);
+  return oled_field_set (f, buf);
+}
+
+void
+oled_field_invalidate (struct oled_field *f)
+{
+  f->drawn = false;
+}
+
+void
+oled_spark_init (struct oled_sparkline *s, int x, int y, int w, int h, int32_t lo, int32_t hi)
+{
+  memset (s, 0, sizeof (*s));
+  s->x = x;
+  s->y = y;
+  s->w = (w > OLED_SPARK_MAX_W) ? OLED_SPARK_MAX_W : w;
+  s->h = h;
+  s->lo = lo;
+  s->hi = (hi > lo) ? hi : lo + 1;
+}
+
+void
+oled_spark_add (struct oled_sparkline *s, int32_t min, int32_t max)
+{
+  if (!s->acc_valid) {
+    s->acc_min = min;
+    s->acc_max = max;
+    s->acc_valid = true;
+    return;
+  }
+  if (min < s->acc_min)
+    s->acc_min = min;
+  if (max > s->acc_max)
+    s->acc_max = max;
+}
+
+// Row of value v on the fixed scale, clamped to the box
+static int
+spark_row (const struct oled_sparkline *s, int32_t v)
+{
+  if (v < s->lo)
+    v = s->lo;
+  if (v > s->hi)
+    v = s->hi;
+  return s->y + s->h - 1 - (int) ((int64_t) (v - s->lo) * (s->h - 1) / (s->hi - s->lo));
+}
+
+// Draw history slot i as screen column x (the column is already clear)
+static void
+spark_column (const struct oled_sparkline *s, int i, int x)
+{
+  if (!s->col_valid[i])
+    return;
+  int top = spark_row (s, s->col_max[i]);
+  int bottom = spark_row (s, s->col_min[i]);
+  ssd1306_fill_rect (x, top, 1, bottom - top + 1, true);
+}
+
+int
+oled_spark_push (struct oled_sparkline *s)
+{
+  int i = s->head;
+
+  s->col_valid[i] = s->acc_valid;
+  s->col_min[i] = s->acc_min;
+  s->col_max[i] = s->acc_max;
+  s->acc_valid = false;
+  s->head = (s->head + 1) % s->w;
+
+  if (!s->drawn)
+    return 0;
+  ssd1306_shift_left (s->x, s->y, s->w, s->h, 1);
+  spark_column (s, i, s->x + s->w - 1);
+  return 1;
+}
+
+int
+oled_spark_draw (struct oled_sparkline *s)
+{
+  if (s->drawn)
+    return 0;
+  ssd1306_fill_rect (s->x, s->y, s->w, s->h, false);
+  // Oldest column is the next slot to be written
+  for (int c = 0; c < s->w; c++)
+    spark_column (s, (s->head + c) % s->w, s->x + c);
+  s->drawn = true;
+  return 1;
+}
+
+void
+oled_spark_invalidate (struct oled_sparkline *s)
+{
+  s->drawn = false;
+}
+
+void
+oled_marquee_init (struct oled_marquee *m, int page)
+{
+  memset (m, 0, sizeof (*m));
+  m->page = page;
+}
+
+// Draw the 128 px of text starting at m->offset, wrapping after the gap
+static void
+marquee_draw_segment (struct oled_marquee *m)
+{
+  int y = m->page * 8;
+  ssd1306_fill_rect (0, y, SSD1306_WIDTH, 8, false);
+  draw_text_prop (-m->offset, y, m->text);
+  if (m->scrolling && m->text_w - m->offset < SSD1306_WIDTH)
+    draw_text_prop (m->text_w - m->offset, y, m->text);
+}
+
+// Next swap one revolution after the last one (or from now), so swaps
+// stay in step with the scroll instead of drifting by the tick jitter
+static void
+marquee_schedule (struct oled_marquee *m, bool from_now)
+{
+  unsigned int ms = ssd1306_scroll_period_ms (OLED_MARQUEE_STEP);
+  if (from_now)
+    clock_gettime (CLOCK_MONOTONIC, &m->next_swap);
+  m->next_swap.tv_sec += ms / 1000;
+  m->next_swap.tv_nsec += (ms % 1000) * 1000000L;
+  if (m->next_swap.tv_nsec >= 1000000000L) {
+    m->next_swap.tv_sec++;
+    m->next_swap.tv_nsec -= 1000000000L;
+  }
+}
+
+int
+oled_marquee_set (struct oled_marquee *m, const char *text)
+{
+  if (m->drawn && strncmp (m->text, text, sizeof (m->text) - 1) == 0)
+    return 0;
+
+  snprintf (m->text, sizeof (m->text), "%s", text);
+  int w = ssd1306_text_width (m->text);
+  bool scroll = w > SSD1306_WIDTH;
+
+  m->text_w = w + OLED_MARQUEE_GAP;
+  m->offset = 0;
+  if (m->scrolling && !scroll)
+    ssd1306_scroll_stop ();
+  m->scrolling = scroll;
+  marquee_draw_segment (m);
+  if (scroll) {
+    ssd1306_scroll_start (SSD1306_SCROLL_LEFT, m->page, m->page, OLED_MARQUEE_STEP);
+    marquee_schedule (m, true);
+  }
+  m->drawn = true;
+  return 1;
+}
+
+int
+oled_marquee_tick (struct oled_marquee *m)
+{
+  struct timespec now;
+
+  if (!m->drawn || !m->scrolling)
+    return 0;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  if (now.tv_sec < m->next_swap.tv_sec
+      || (now.tv_sec == m->next_swap.tv_sec && now.tv_nsec < m->next_swap.tv_nsec))
+    return 0;
+
+  // The page is back where it started; bring in the next segment. The
+  // push restarts the scroll from it.
+  m->offset = (m->offset + SSD1306_WIDTH) % m->text_w;
+  marquee_draw_segment (m);
+  marquee_schedule (m, false);
+  return 1;
+}
+
+void
+oled_marquee_invalidate (struct oled_marquee *m)
+{
+  if (m->scrolling)
+    ssd1306_scroll_stop ();
+  m->scrolling = false;
+  m->drawn = false;
+}
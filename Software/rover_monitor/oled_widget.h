@@ -0,0 +1,115 @@
+#ifndef OLED_WIDGET_H
+#define OLED_WIDGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OLED_FIELD_TEXT_MAX 40
+
+/* A retained text field with a fixed box on the SSD1306 framebuffer.
+ * It remembers what it last drew; setting the same text again draws
+ * nothing. New text clears the box and redraws it, so only changed
+ * fields reach the framebuffer (and the display's dirty regions).
+ * A label is a field whose text is set once.
+ */
+struct oled_field {
+  int x, y, w, h;                       /* box, text drawn at (x, y) */
+  bool drawn;                           /* text below is on screen */
+  char text[OLED_FIELD_TEXT_MAX];
+};
+
+/* Height of one line of 5x7 text */
+#define OLED_FIELD_LINE_H 8
+
+void oled_field_init(struct oled_field *f, int x, int y, int w, int h);
+
+/* Draw text if it differs from what is on screen. Returns 1 if the field
+ * was redrawn, 0 if unchanged. Call with the display lock held.
+ */
+int oled_field_set(struct oled_field *f, const char *text);
+int oled_field_setf(struct oled_field *f, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Forget what is on screen, e.g. after another page replaced it; the
+ * next set redraws the field.
+ */
+void oled_field_invalidate(struct oled_field *f);
+
+/* Sparkline: a min/max bar per column over a fixed scale, newest on the
+ * right. Values are accumulated into the current interval; closing the
+ * interval stores it in the history ring and, while the sparkline is on
+ * screen, shifts the box one column left and draws only the new column.
+ */
+#define OLED_SPARK_MAX_W 64
+
+struct oled_sparkline {
+  int x, y, w, h;
+  int32_t lo, hi;                       /* values mapped to the bottom / top row */
+  int32_t col_min[OLED_SPARK_MAX_W];    /* history ring, one interval per column */
+  int32_t col_max[OLED_SPARK_MAX_W];
+  bool col_valid[OLED_SPARK_MAX_W];     /* false: no samples in that interval */
+  int head;                             /* slot of the next column */
+  bool acc_valid;                       /* interval being accumulated */
+  int32_t acc_min, acc_max;
+  bool drawn;
+};
+
+/* w is clamped to OLED_SPARK_MAX_W. History starts empty. */
+void oled_spark_init(struct oled_sparkline *s, int x, int y, int w, int h,
+                     int32_t lo, int32_t hi);
+
+/* Fold a [min, max] range into the current interval */
+void oled_spark_add(struct oled_sparkline *s, int32_t min, int32_t max);
+
+/* Close the current interval. Draws when on screen (display lock held).
+ * Returns 1 if the framebuffer changed.
+ */
+int oled_spark_push(struct oled_sparkline *s);
+
+/* Draw the whole history if it is not on screen. Returns 1 if drawn. */
+int oled_spark_draw(struct oled_sparkline *s);
+void oled_spark_invalidate(struct oled_sparkline *s);
+
+/* Marquee: one page (8 rows) of text that may be wider than the screen.
+ * Text that fits is drawn still. Longer text is cut into 128 px segments;
+ * the controller scrolls the page left on its own, and once per
+ * revolution the next segment is drawn in, so the CPU and the bus only
+ * work once per segment. The scroll covers the whole page width.
+ */
+#define OLED_MARQUEE_TEXT_MAX 96
+#define OLED_MARQUEE_GAP      16        /* blank pixels between repeats */
+#define OLED_MARQUEE_STEP     SSD1306_SCROLL_2_FRAMES
+
+struct oled_marquee {
+  int page;
+  char text[OLED_MARQUEE_TEXT_MAX];
+  int text_w;                           /* text width plus the gap */
+  int offset;                           /* text x shown at screen column 0 */
+  bool drawn;
+  bool scrolling;
+  struct timespec next_swap;            /* CLOCK_MONOTONIC */
+};
+
+void oled_marquee_init(struct oled_marquee *m, int page);
+
+/* Show text (display lock held). Returns 1 if the framebuffer changed. */
+int oled_marquee_set(struct oled_marquee *m, const char *text);
+
+/* Draw the next segment when a revolution has passed. Call regularly
+ * with the display lock held. Returns 1 if the framebuffer changed.
+ */
+int oled_marquee_tick(struct oled_marquee *m);
+
+/* Stop scrolling and forget what is on screen (display lock held) */
+void oled_marquee_invalidate(struct oled_marquee *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,18 +3,66 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
 
 #include "os_calls.h"
+#include "event_loop.h"
+
+extern char **environ;
+
+// The setup,bash is required to setup the ROS 2 Jazzy environment
+// The "&" is required so system returns and let ROS2 run in the background. 
+static const char *ros2_start_cmd = "/bin/bash -c 'source /home/jerryo/osr_ws/install/setup.bash && ros2 launch osr_bringup osr_launch.py &'";
+static const char *ros2_stop_cmd = "pkill -9 -f 'ros2|roboclaw_wrapper|servo_wrapper|teleop_twist_joy|ina260_node|joy|osr_control'";
+
+// Start "/bin/sh -c cmd" with the signal mask from before the event loop
+// blocked its signals (system() would pass the blocked mask on).
+// Returns the shell's pid, or -1 with errno set.
+static pid_t spawn_shell(const char *cmd)
+{
+    posix_spawnattr_t attr;
+    sigset_t mask, dfl;
+    pid_t pid;
+
+    evloop_child_sigmask(&mask);
+    sigfillset(&dfl);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &dfl);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    char *argv[] = { "/bin/sh", "-c", (char *)cmd, NULL };
+    int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+// Like system(), through spawn_shell()
+static int run_shell(const char *cmd)
+{
+    int status;
+    pid_t pid = spawn_shell(cmd);
+
+    if (pid < 0)
+        return -1;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return -1;
+    }
+    return status;
+}
 
 int start_rover(void)
 {
     int system_call_status = 0;
     
-    // The setup,bash is required to setup the ROS 2 Jazzy environment
-    // The "&" is required so system returns and let ROS2 run in the background. 
-    const char *ros2_start_cmd = "/bin/bash -c 'source /home/jerryo/osr_ws/install/setup.bash && ros2 launch osr_bringup osr_launch.py &'";
-
-    int result = system(ros2_start_cmd);
+    int result = run_shell(ros2_start_cmd);
     if (result == -1) {
         perror("Failed to execute system call");
         return 1;
@@ -41,23 +89,34 @@ pkill -9 -f  osr_control
 #endif
 
 //    const char* ros2_stop_cmd = "pkill -9 -f 'launch|roboclaw_wrapper|servo_control|rover|joy_node|ina260'";
-    const char* ros2_stop_cmd = "pkill -9 -f 'ros2|roboclaw_wrapper|servo_wrapper|teleop_twist_joy|ina260_node|joy|osr_control'";
 
-    system_call_status = system(ros2_stop_cmd);
+    system_call_status = run_shell(ros2_stop_cmd);
 
     return system_call_status;
 }
 
 int os_shutdown(void) {
-    int system_call_status = system("shutdown -h now");
+    int system_call_status = run_shell("shutdown -h now");
     return system_call_status;
 }
 
 int os_reboot(void) {
-    int  system_call_status = system("reboot");
+    int  system_call_status = run_shell("reboot");
     return system_call_status;
 }
 
+pid_t spawn_start_rover(void) {
+    return spawn_shell(ros2_start_cmd);
+}
+
+pid_t spawn_stop_rover(void) {
+    return spawn_shell(ros2_stop_cmd);
+}
+
+pid_t spawn_shutdown(void) {
+    return spawn_shell("shutdown -h now");
+}
+
 /**
  * Checks if the current hardware is a Raspberry Pi.
  * Returns 1 if true, 0 otherwise.
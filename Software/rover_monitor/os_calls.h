@@ -2,6 +2,7 @@
 #define OS_CALLS_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 // Function prototypes
 int start_rover(void);
@@ -10,4 +11,9 @@ int os_reboot(void);
 int os_shutdown(void);
 int is_raspberry_pi();
 
+// Same commands without waiting: return the pid to reap, or -1 on error
+pid_t spawn_start_rover(void);
+pid_t spawn_stop_rover(void);
+pid_t spawn_shutdown(void);
+
 #endif
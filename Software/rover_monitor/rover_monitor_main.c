@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <limits.h>
 #include <linux/i2c-dev.h>
 #include <net/if.h>
 #include <netinet/in.h>
@@ -49,17 +50,50 @@
 #include <stdatomic.h>          // Required for atomic operations
 #include <pthread.h>            // Required for pthreads
 
+#include "i2c_bus.h"
 #include "ina260.h"
+#include "ina260_acq.h"
+#include "ina260_alert.h"
+#include "energy.h"
 #include "os_calls.h"
 #include "rover_pin_drv.h"
 #include "buttons.h"
 #include "ssd1306.h"
+#include "ssd1306_transport.h"
+#include "ssd1306_virtual.h"
+#include "status_screen.h"
+#include "event_loop.h"
+#include "net_watch.h"
+#include "wifi_watch.h"
+#include "sys_sampler.h"
 
 #define VOLATGE_HIGH_LIMIT (16000.0)    // 16 volts
 #define VOLATGE_LOW_LIMIT  (12000.0)    // 12 volts
 #define CURRENT_HIGH_LIMIT  (7000.0)    // 7 amps
+#define INA260_PRESET        INA260_PRESET_FAST_FAULT   // short conversions, no averaging
+#define INA260_ACQ_MODE      INA260_ACQ_CVRF_POLL       // read each conversion exactly once
+#define INA260_ACQ_PERIOD_US 0          // 0 = one sample per INA260 conversion
+// Limit the INA260 watches in hardware and signals on ALERT (only one at a time).
+// Off by default: ALERT isn't wired on r5 boards, and an unconnected pin
+// would read as a permanent fault. Set to 1 on boards with ALERT on INA260_ALERT_PIN.
+#define INA260_HW_ALERT_ENABLE 0
+#define INA260_HW_ALERT       INA260_ME_BUL
+#define INA260_HW_ALERT_LIMIT VOLATGE_LOW_LIMIT
+#define INA260_HW_ALERT_MSG   "Under Voltage Fault"
+#define TICK_MS              300        // status tick: battery, faults, sparklines, marquee
+#define SYSINFO_MS           1000       // IP, SSID, CPU temperature and uptime
+#define ALARM_HALF_PERIOD_MS 300        // alarm LED/buzzer on time, then off time
+#define ENERGY_SAVE_TICKS    200        // persist energy totals about once a minute
+#define I2C_DIAG_TICKS       17         // show the I2C stats page ~5 s after SIGUSR1
+// Battery sparklines on the status page: one column per ~1 s, 48 s shown
+#define SPARK_TICKS_PER_COL  3
+#define SPARK_VOLTAGE_LO_MV  (11000.0)
+#define SPARK_VOLTAGE_HI_MV  (17000.0)
+#define SPARK_CURRENT_HI_MA  CURRENT_HIGH_LIMIT
 #define OLED_I2C_DEV   "/dev/i2c-1"
 #define OLED_ADDR      0x3c     // 0x3C
+#define OLED_TRANSPORT ssd1306_i2c_transport    // or ssd1306_spi_transport, ssd1306_fb_transport
+#define OLED_VIRTUAL_SHM "/rover_monitor_oled"  // --virtual: frames published here
 #define CHIPNAME       "gpiochip0"
 
 // gpio outputs
@@ -70,9 +104,10 @@
 // gpio inputs
 #define SHUTDOWN_BUTTON_PIN 19
 #define RUN_STOP_BUTTON_PIN 21
+#define INA260_ALERT_PIN    26          // INA260 ALERT, requested with a pull-up; not wired on r5 boards
 
-static int i2c_ina260_fd;
 static int ina260_online = 0;
+static int ina260_hw_alert = 0;
 static int rover_run_state = 0;
 
 void process_shutdown (int pin_num);
@@ -135,55 +170,16 @@ get_ip_address (char *out, size_t outlen)
   return rc;
 }
 
-static int
-get_wifi_ssid (char *out, size_t outlen)
-{
-  // Use iwgetid -r if available (simple + robust)
-  FILE *fp = popen ("iwgetid -r 2>/dev/null", "r");
-  if (!fp)
-    return -1;
-  if (!fgets (out, (int) outlen, fp)) {
-    pclose (fp);
-    return -1;
-  }
-  pclose (fp);
-  // strip newline
-  size_t n = strlen (out);
-  while (n && (out[n - 1] == '\n' || out[n - 1] == '\r')) {
-    out[--n] = 0;
-  }
-  if (n == 0)
-    return -1;
-  return 0;
-}
-
-static int
-get_cpu_temp_c (double *outC)
-{
-  FILE *f = fopen ("/sys/class/thermal/thermal_zone0/temp", "r");
-  if (!f)
-    return -1;
-  long t = 0;
-  if (fscanf (f, "%ld", &t) != 1) {
-    fclose (f);
-    return -1;
-  }
-  fclose (f);
-  *outC = t / 1000.0;
-  return 0;
-}
+// sysfs/procfs values, opened once and re-read with pread()
+enum { SYS_CPU_TEMP, SYS_UPTIME, SYS_NUM_SOURCES };
+static struct sys_source sys_src[SYS_NUM_SOURCES] = {
+  [SYS_CPU_TEMP] = {"/sys/class/thermal/thermal_zone0/temp", 0},    // millidegrees C
+  [SYS_UPTIME] = {"/proc/uptime", 2},   // hundredths of a second
+};
 
 static void
-fmt_uptime (char *out, size_t outlen)
+fmt_uptime (char *out, size_t outlen, unsigned long s)
 {
-  // Read from /proc/uptime
-  FILE *f = fopen ("/proc/uptime", "r");
-  double up = 0.0;
-  if (f) {
-    int i = fscanf (f, "%lf", &up);
-    fclose (f);
-  }
-  unsigned long s = (unsigned long) (up + 0.5);
   unsigned long d = s / 86400;
   s %= 86400;
   unsigned long h = s / 3600;
@@ -192,23 +188,86 @@ fmt_uptime (char *out, size_t outlen)
   snprintf (out, outlen, "%lud %02lu:%02lu", d, h, m);
 }
 
-static void
-get_ina260_status (float *voltage_mv, float *current_ma)
+// Rail readings over one main loop tick, taken from the acquisition ring
+struct ina260_window
 {
-  *voltage_mv = ina260_read_voltage_mV (i2c_ina260_fd);
-  *current_ma = ina260_read_current_mA (i2c_ina260_fd);
-}
-
-// ======== GPIO / shutdown handling ========
-static volatile sig_atomic_t keepRunning = 1;
-
+  int count;                    // samples seen this tick
+  struct ina260_sample last;    // newest sample, for the display
+  int32_t min_voltage_raw;      // worst case over the tick, for the fault checks
+  int32_t max_voltage_raw;
+  int32_t min_current_raw;
+  int32_t max_current_raw;
+};
+
+// ======== Power rails ========
+// One INA260 per rail, all on the same I2C bus, each with its own limits
+// (in INA260 counts, so the per-sample checks are integer compares) and
+// its own status line. Rail 0 is the main battery feed and is required;
+// the others are only monitored if a sensor answers at their address.
+struct rail
+{
+  const char *name;
+  uint8_t addr;
+  int optional;
+  int32_t low_voltage_raw;
+  int32_t high_voltage_raw;
+  int32_t high_current_raw;
+
+  struct ina260_dev dev;
+  int online;
+  int acq_idx;                  // index into the acquisition thread's rings
+  struct sample_ring_reader rd;
+  struct ina260_window win;
+  char status[32];
+};
+
+#define RAIL(name, addr, optional, low_mv, high_mv, high_ma) \
+  { name, addr, optional, INA260_mV_TO_RAW (low_mv), INA260_mV_TO_RAW (high_mv), \
+    INA260_mA_TO_RAW (high_ma) }
+
+static struct rail rails[] = {
+  RAIL ("Bat", INA260_ADDRESS, 0, VOLATGE_LOW_LIMIT, VOLATGE_HIGH_LIMIT, CURRENT_HIGH_LIMIT),
+  RAIL ("MotorL", 0x41, 1, 12000.0, 16000.0, 5000.0),   // RoboClaw 1 supply
+  RAIL ("MotorR", 0x44, 1, 12000.0, 16000.0, 5000.0),   // RoboClaw 2 supply
+  RAIL ("Servo", 0x46, 1, 4800.0, 6500.0, 3000.0),      // servo rail
+};
+
+#define NUM_RAILS ((int) (sizeof (rails) / sizeof (rails[0])))
+
+// Drain every sample published since the last call. Short brownouts and
+// current spikes between ticks still show up in the min/max values.
 static void
-sigint_handler (int sig)
+get_ina260_status (struct rail *r)
 {
-  (void) sig;
-  keepRunning = 0;
+  struct ina260_window *w = &r->win;
+  struct sample_ring *ring = ina260_acq_ring (r->acq_idx);
+  struct ina260_sample batch[64];
+  int n;
+
+  w->count = 0;
+  while ((n = sample_ring_read (ring, &r->rd, batch, 64)) > 0) {
+    for (int i = 0; i < n; i++) {
+      const struct ina260_sample *s = &batch[i];
+      if (w->count == 0) {
+        w->min_voltage_raw = w->max_voltage_raw = s->voltage_raw;
+        w->min_current_raw = w->max_current_raw = s->current_raw;
+      }
+      if (s->voltage_raw < w->min_voltage_raw)
+        w->min_voltage_raw = s->voltage_raw;
+      if (s->voltage_raw > w->max_voltage_raw)
+        w->max_voltage_raw = s->voltage_raw;
+      if (s->current_raw < w->min_current_raw)
+        w->min_current_raw = s->current_raw;
+      if (s->current_raw > w->max_current_raw)
+        w->max_current_raw = s->current_raw;
+      w->last = *s;
+      w->count++;
+    }
+  }
+  // count == 0 means the acquisition thread got no readings this tick
 }
 
+// ======== GPIO / shutdown handling ========
 static struct gpiod_chip *chip = NULL;
 static struct gpiod_line *btn_line = NULL;
 static struct gpiod_line *rs_btn_line = NULL;
@@ -218,6 +277,12 @@ static void cb_print(int pin) {
     fflush(stdout);
 }
 
+static void
+button_ready (int fd, uint32_t events, void *arg)
+{
+  buttons_dispatch ((int) (intptr_t) arg);
+}
+
 static int
 gpio_init (void)
 {
@@ -242,12 +307,19 @@ gpio_init (void)
      button_callback(19, process_shutdown);
      button_callback(21, process_run_stop_button);  
   }
+  // Presses are read on the event loop; the callbacks run there
+  if (evloop_add_fd (buttons_fd (SHUTDOWN_BUTTON_PIN), EPOLLIN, button_ready,
+                     (void *) (intptr_t) SHUTDOWN_BUTTON_PIN) < 0
+      || evloop_add_fd (buttons_fd (RUN_STOP_BUTTON_PIN), EPOLLIN, button_ready,
+                        (void *) (intptr_t) RUN_STOP_BUTTON_PIN) < 0)
+    return 1;
   return 0;
 }
 
 static void
 gpio_cleanup (void)
 {
+  buttons_shutdown ();
 
   if (btn_line) {
     gpiod_line_release (btn_line);
@@ -263,334 +335,689 @@ gpio_cleanup (void)
   }
 }
 
-char status_line[32] = { "Status: Okay" };
-
 // ======== UI helpers ========
+// Feed one tick of battery readings to the sparklines, and every
+// SPARK_TICKS_PER_COL ticks scroll in a new column
 static void
-draw_status_screen (const char *hostname, const char *ip, const char *ssid, double tempC,
-                    const char *uptime, double voltage_mv, double current_ma)
+update_sparklines (const struct ina260_window *w, int tick_cntr)
 {
-  ssd1306_clear ();
-  int y = 0;
-
-  draw_text_prop (0, y, "Host: ");
-  draw_text_prop (34, y, hostname && *hostname ? hostname : "—");
-
-  y += 12;
-  draw_text_prop (0, y, "IP: ");
-  draw_text_prop (24, y, ip && *ip ? ip : "—");
-
-//  draw_text_prop (0, y, "SSID: ");
-//  draw_text_prop (34, y, ssid && *ssid ? ssid : "—");
-  y += 12;
-
-  // char tbuf[32]; snprintf(tbuf, sizeof tbuf, "CPU: %.1f\xC2\xB0""C", tempC);
-  char tbuf[32];
-  snprintf (tbuf, sizeof tbuf, "CPU: %.1f " "C", tempC);
-
-  draw_text_prop (0, y, tbuf);
-  y += 12;
-
-//    char ubuf[32]; snprintf(ubuf, sizeof ubuf, "Up: %s", uptime);
-//    draw_text_prop(0, y, ubuf); y += 12;
-
-//    draw_text_prop(0, y, "Btn: Shutdown"); // hint line
-  char vbuf[32];
-  snprintf (vbuf, sizeof (vbuf), "Bat:  %3.2fV,   %3.2fA", voltage_mv / 1000.0,
-            current_ma / 1000.0);
-  draw_text_prop (0, y, vbuf);
-  y += 12;
+  if (w->count > 0)
+    status_page_spark_add (w->min_voltage_raw, w->max_voltage_raw,
+                           w->min_current_raw, w->max_current_raw);
+  if ((tick_cntr + 1) % SPARK_TICKS_PER_COL == 0)
+    status_page_spark_push ();
+}
 
-//    char sbuf[32]; snprintf(sbuf,sizeof(sbuf),"%s",status_line);
-//    draw_text_prop(0, y, sbuf); y += 12;
+// I2C diagnostic page: bus utilization, then one line per device
+// with transaction count, p99 latency and error total
+static void
+draw_i2c_diag_screen (void)
+{
+  char buf[40];
+  uint8_t addrs[5];
+  int n = i2c_bus_active_addrs (addrs, 5);
 
-  char rbuf[32];
-  if (rover_run_state) {
-    snprintf (rbuf, sizeof (rbuf), "%s", "Rover App:  On");
-  }
-  else {
-    snprintf (rbuf, sizeof (rbuf), "%s", "Rover App:  Off");
+  ssd1306_lock ();
+  status_page_hide ();
+  ssd1306_clear ();
+  snprintf (buf, sizeof (buf), "I2C busy: %.1f%%", i2c_bus_utilization ());
+  draw_text_prop (0, 0, buf);
+  for (int i = 0; i < n; i++) {
+    struct i2c_bus_stats st;
+    if (i2c_bus_get_stats (addrs[i], &st) != 0)
+      continue;
+    snprintf (buf, sizeof (buf), "%02X n=%lu p99<%luus e=%lu", addrs[i], st.xfers,
+              i2c_bus_percentile_us (&st, 99), st.nack + st.eio + st.timeout + st.other_err);
+    draw_text_prop (0, 10 * (i + 1), buf);
   }
-  draw_text_prop (0, y, rbuf);
-  y += 12;
-
-  // Optional: underline separator
-//    ssd1306_hline(0, 10, 128, true);
   ssd1306_update ();
+  ssd1306_unlock ();
 }
 
 static void
 draw_message_center (const char *msg)
 {
+  ssd1306_lock ();
+  status_page_hide ();
   ssd1306_clear ();
   // crude center: we just start near center; the prop renderer will help
   int y = (SSD1306_HEIGHT / 2) - 4;
   int x = 8;
   draw_text_prop (x, y, msg);
   ssd1306_update ();
+  ssd1306_unlock ();
 }
 
+// Probe and configure every rail's INA260 on the shared bus, then start
+// one acquisition thread that samples all online rails in a single sweep.
 int
 ina260_setup ()
 {
-  i2c_ina260_fd = open ("/dev/i2c-1", O_RDWR);
-  if (i2c_ina260_fd < 0) {
+  struct ina260_dev *devs[NUM_RAILS];
+  int ndev = 0;
+
+  if (i2c_bus_open (I2C_BUS_DEV) < 0) {
     perror ("Unable to open I2C device");
     return 1;
   }
 
-  if (ioctl (i2c_ina260_fd, I2C_SLAVE, INA260_ADDRESS) < 0) {
-    perror ("Failed to set I2C address");
-    return 2;
+  for (int i = 0; i < NUM_RAILS; i++) {
+    struct rail *r = &rails[i];
+
+    r->online = 0;
+    snprintf (r->status, sizeof (r->status), "%s: off line", r->name);
+    if (ina260_open (&r->dev, r->addr, r->name) != 0) {
+      if (!r->optional) {
+        printf ("INA260 %s init failed\n", r->name);
+        return 3;
+      }
+      continue;
+    }
+    if (ina260_configure_preset (&r->dev, INA260_PRESET) != 0) {
+      printf ("INA260 %s configure failed\n", r->name);
+      if (!r->optional)
+        return 4;
+      continue;
+    }
+    r->online = 1;
+    r->acq_idx = ndev;
+    devs[ndev++] = &r->dev;
+  }
+  printf ("ina260 %d rail(s), conversion period %u us\n", ndev,
+          ina260_conversion_period_us (&rails[0].dev.cfg));
+
+  // ALERT carries conversion ready in that mode, so it can't signal faults too
+  ina260_hw_alert = 0;
+  if (INA260_HW_ALERT_ENABLE && INA260_ACQ_MODE != INA260_ACQ_CVRF_ALERT) {
+    if (ina260_set_alert (&rails[0].dev, INA260_HW_ALERT, INA260_HW_ALERT_LIMIT) == 0)
+      ina260_hw_alert = 1;
+    else
+      printf ("INA260 alert limit setup failed\n");
   }
 
-  if (ina260_init (i2c_ina260_fd) != 0) {
-    printf ("INA260 init failed\n");
-    return 3;
+  if (ina260_acq_start (devs, ndev, INA260_ACQ_MODE, INA260_ACQ_PERIOD_US, INA260_ALERT_PIN) != 0)
+    return 5;
+  for (int i = 0; i < NUM_RAILS; i++) {
+    if (rails[i].online)
+      sample_ring_reader_init (ina260_acq_ring (rails[i].acq_idx), &rails[i].rd);
   }
   return 0;
 }
 
-// Shared flag to control the background sound thread
-// Using atomic ensures visibility across threads without a mutex
-atomic_bool sound_enabled = false;
+// Update a rail's status line from this tick's window. Returns true if
+// the rail should sound the alarm. A fault holds for as long as the window
+// shows it; the alarm timer does the blinking.
+static bool
+check_rail (struct rail *r, bool *changed)
+{
+  const char *msg;
+  bool alarm = true;
+
+  if (r == &rails[0] && ina260_hw_alert && ina260_alert_asserted ()) {
+    // Alarm was already started by the ALERT callback
+    msg = INA260_HW_ALERT_MSG;
+  }
+  else if (r->win.count == 0) {
+    // No readings is a sensor/bus problem, not an under-voltage
+    msg = "no data";
+    alarm = false;
+  }
+  else if (r->win.min_voltage_raw < r->low_voltage_raw) {
+    msg = "Under Voltage Fault";
+    // Should we do something else here? ie shut down ROS2??
+  }
+  else if (r->win.max_voltage_raw > r->high_voltage_raw) {
+    msg = "Over Voltage Fault";
+  }
+  else if (r->win.max_current_raw > r->high_current_raw) {
+    msg = "Over Current Fault";
+  }
+  else {
+    msg = "Okay";
+    alarm = false;
+  }
+
+  char status[sizeof (r->status)];
+  snprintf (status, sizeof (status), "%s: %s", r->name, msg);
+  if (strcmp (status, r->status) != 0) {
+    strcpy (r->status, status);
+    simple_logf ("%s", r->status);
+    *changed = true;
+  }
+  return alarm;
+}
+
+// Alarm: red LED and buzzer on/off every ALARM_HALF_PERIOD_MS, driven by
+// a timerfd on the event loop. Atomic because the ALERT thread raises it.
+static atomic_bool sound_enabled = false;
+static int alarm_tfd = -1;
+static atomic_int alarm_phase = 0;
+
+static void
+alarm_timer (int fd, uint32_t expirations, void *arg)
+{
+  int on = atomic_fetch_xor (&alarm_phase, 1) ^ 1;
+  rover_pin_drv_set_red (on);
+  rover_pin_drv_set_buzzer (on);
+}
+
+// Start or stop the alarm; only a change of state touches the pins
+static void
+sound_set (bool on)
+{
+  if (atomic_exchange (&sound_enabled, on) == on)
+    return;
+  if (on) {
+    atomic_store (&alarm_phase, 1);
+    rover_pin_drv_set_red (1);
+    rover_pin_drv_set_buzzer (1);
+    evloop_set_timer (alarm_tfd, ALARM_HALF_PERIOD_MS, ALARM_HALF_PERIOD_MS);
+  }
+  else {
+    evloop_set_timer (alarm_tfd, 0, 0);
+    rover_pin_drv_set_red (0);
+    rover_pin_drv_set_buzzer (0);
+  }
+}
+
+// Runs on the ALERT watcher thread, within a millisecond of the INA260
+// tripping its limit. Sound the alarm now; the status tick keeps it going.
+static void
+ina260_alert_fault (int asserted)
+{
+  if (asserted) {
+    sound_set (true);
+    simple_logf ("INA260 ALERT: %s", INA260_HW_ALERT_MSG);
+  }
+  else {
+    simple_logf ("INA260 ALERT cleared");
+  }
+}
+
+// ======== Main loop ========
+// Everything below runs on the event loop thread
+static struct
+{
+  char hostname[50];
+  char ip[64];
+  char ssid[64];
+  double tempC;
+  char uptime[32];
+  struct ina260_sample bat;
+  int bat_valid;
+  struct energy_totals energy;
+  int tick_cntr;
+  int diag_ticks;               // status ticks left on the I2C page or a message
+  int idle_ticks;
+} mon;
+
+static void
+show_status (void)
+{
+  draw_status_screen (mon.hostname, mon.ip, mon.ssid, mon.tempC, mon.uptime,
+                      mon.bat_valid ? &mon.bat : NULL, &mon.energy, rover_run_state);
+}
 
-// Sound Function runs in a background thread
-void *
-background_sound_thread (void *arg)
+// ======== Button actions ========
+// A press starts a sequence of commands and delays. Each step begins when
+// the previous command exits (reaped on the loop) or action_tfd fires, so
+// the loop keeps running while pkill, ros2 and shutdown do their work.
+enum action_step
 {
-  while (1) {
-    while (atomic_load (&sound_enabled)) {
-      rover_pin_drv_set_red (1);
-      rover_pin_drv_set_buzzer (1);
+  ACT_IDLE,
+  ACT_SHUTDOWN_STOP,            // stopping the rover before halting
+  ACT_SHUTDOWN_LEDS,            // LEDs on while the message shows
+  ACT_SHUTDOWN_HALT,            // LEDs off, then shutdown
+  ACT_HALTING,                  // shutdown requested
+  ACT_ROVER_STOP,               // run/stop button: stopping
+  ACT_ROVER_RESTART,            // run/stop button: stopping, then start
+  ACT_ROVER_START,              // stopped, start after a short delay
+};
+
+#define SHUTDOWN_STEP_MS 400
+#define ROVER_RESTART_MS 10
+
+static int action_tfd = -1;
+static enum action_step action = ACT_IDLE;
 
-      usleep (300000);
-      // } else {
-      rover_pin_drv_set_red (0);
-      rover_pin_drv_set_buzzer (0);
-      // Sleep briefly to prevent a busy-wait loop when sound is off
-      usleep (300000);
+static void
+action_child_done (pid_t pid, int status, void *arg)
+{
+  // A command from an earlier sequence, e.g. start_rover after a restart
+  if ((intptr_t) arg != action)
+    return;
+
+  switch (action) {
+  case ACT_SHUTDOWN_STOP:
+    action = ACT_SHUTDOWN_LEDS;
+    evloop_set_timer (action_tfd, SHUTDOWN_STEP_MS, 0);
+    break;
+  case ACT_ROVER_STOP:
+    printf ("'stop_rover.sh' script finished.\n");
+    rover_pin_drv_set_green (0);
+    action = ACT_IDLE;
+    break;
+  case ACT_ROVER_RESTART:
+    action = ACT_ROVER_START;
+    evloop_set_timer (action_tfd, ROVER_RESTART_MS, 0);
+    break;
+  case ACT_HALTING:
+    if (status != 0) {
+      simple_logf ("shutdown failed (status %d)", status);
+      mon.diag_ticks = 1;       // back to the status page
+      action = ACT_IDLE;
     }
+    break;
+  default:
+    break;
+  }
+}
+
+// Continue the sequence at step once the command exits; if it didn't
+// start, carry on without it
+static void
+action_wait (pid_t pid, enum action_step step)
+{
+  if (pid >= 0 && evloop_add_child (pid, action_child_done, (void *) (intptr_t) step) == 0)
+    return;
+  fprintf (stderr, "Button action: command failed\n");
+  action_child_done (pid, -1, (void *) (intptr_t) step);
+}
+
+static void
+action_timer (int fd, uint32_t expirations, void *arg)
+{
+  switch (action) {
+  case ACT_SHUTDOWN_LEDS:
+    // brief delay so the message is visible
+    rover_pin_drv_set_green (0);
+    rover_pin_drv_set_red (0);
+    rover_pin_drv_set_buzzer (0);
+    action = ACT_SHUTDOWN_HALT;
+    evloop_set_timer (action_tfd, SHUTDOWN_STEP_MS, 0);
+    break;
+  case ACT_SHUTDOWN_HALT:
+    // Request shutdown
+    action = ACT_HALTING;
+    action_wait (spawn_shutdown (), ACT_HALTING);
+    break;
+  case ACT_ROVER_START:
+    rover_pin_drv_set_green (1);
+    action = ACT_IDLE;
+    action_wait (spawn_start_rover (), ACT_IDLE);
+    break;
+  default:
+    break;
   }
-  return NULL;
 }
 
 void
 process_shutdown (int pin_num)
 {
+  if (action == ACT_HALTING || (action >= ACT_SHUTDOWN_STOP && action <= ACT_SHUTDOWN_HALT))
+    return;
   simple_logf ("Button pressed: initiating shutdown");
   draw_message_center ("Shutting down...");
+  mon.diag_ticks = INT_MAX;     // keep the message up until power goes
   // turn off LED to indicate it's safe to cut power *after* OS halts
   rover_pin_drv_set_green (1);
   rover_pin_drv_set_red (1);
   rover_pin_drv_set_buzzer (1);
 
-  stop_rover ();  // Make sure the rovers motors are stop
-  usleep (400 * 1000);
-
-  // brief delay so the message is visible
-  rover_pin_drv_set_green (0);
-  rover_pin_drv_set_red (0);
-  rover_pin_drv_set_buzzer (0);
-  usleep (400 * 1000);
-
-  // Request shutdown
-  int s = system ("shutdown -h now");
+  // Make sure the rovers motors are stop; this replaces any run/stop sequence
+  evloop_set_timer (action_tfd, 0, 0);
+  action = ACT_SHUTDOWN_STOP;
+  action_wait (spawn_stop_rover (), ACT_SHUTDOWN_STOP);
 }
 
 void
 process_run_stop_button (int pin_num)
 {
+  if (action != ACT_IDLE) {
+    simple_logf ("RS Button pressed: busy, ignored");
+    return;
+  }
   simple_logf ("RS Button pressed: ??");
   draw_message_center ("Bell button pressed");
   // Toggle Rover run state
   if (rover_run_state != 0) {
     printf ("Stop Rover\n");
     rover_run_state = 0;
-    stop_rover ();
-
-    printf ("'stop_rover.sh' script finished.\n");
-    rover_pin_drv_set_green (0);
+    action = ACT_ROVER_STOP;
+    action_wait (spawn_stop_rover (), ACT_ROVER_STOP);
   }
   else {
     printf ("Start Rover\n");
     rover_run_state = 1;
-    stop_rover(); // make sure everthing thing is stopped
-    usleep (10 * 1000);         // 10 millsec ?
+    // make sure everthing thing is stopped first
+    action = ACT_ROVER_RESTART;
+    action_wait (spawn_stop_rover (), ACT_ROVER_RESTART);
+  }
+}
 
-    rover_pin_drv_set_green (1);
-    start_rover ();
+static int net_fd = -1;         // rtnetlink watch, or -1 to poll getifaddrs()
+
+// Take the IP from the netlink table (no syscalls), or poll for it if
+// the watch isn't running; true if it changed
+static bool
+update_ip (void)
+{
+  char ip[64];
+  int rc = net_fd >= 0 ? net_watch_ipv4 (ip, sizeof ip) : get_ip_address (ip, sizeof ip);
+
+  if (rc != 0)
+    strncpy (ip, "—", sizeof ip);
+  if (strcmp (ip, mon.ip) == 0)
+    return false;
+  strncpy (mon.ip, ip, sizeof mon.ip);
+  return true;
+}
+
+// The kernel reported a link or IPv4 address change
+static void
+net_ready (int fd, uint32_t events, void *arg)
+{
+  if (net_watch_process () > 0 && update_ip () && mon.diag_ticks == 0)
+    show_status ();
+}
+
+static int wifi_fd = -1;        // nl80211 events, or -1 without Wi-Fi
+
+// Take the SSID from the last nl80211 link read; true if it changed
+static bool
+update_ssid (void)
+{
+  const struct wifi_link *l = wifi_watch_link ();
+  const char *ssid = wifi_fd >= 0 && l->associated ? l->ssid : "—";
+
+  if (strcmp (ssid, mon.ssid) == 0)
+    return false;
+  strncpy (mon.ssid, ssid, sizeof mon.ssid);
+  return true;
+}
+
+// Connect, roam or disconnect: the link was re-read if it was ours
+static void
+wifi_ready (int fd, uint32_t events, void *arg)
+{
+  if (wifi_watch_process () <= 0)
+    return;
+
+  const struct wifi_link *l = wifi_watch_link ();
+  if (l->associated)
+    simple_logf ("Wi-Fi %s: %s, %d dBm, %.1f Mbit/s", l->ifname, l->ssid, l->signal_dbm,
+                 l->bitrate_kbps / 1000.0);
+  else
+    simple_logf ("Wi-Fi %s: not associated", l->ifindex ? l->ifname : "-");
+  if (update_ssid () && mon.diag_ticks == 0)
+    show_status ();
+}
+
+// Read the slow-changing system values; true if any of them changed
+static bool
+read_sysinfo (void)
+{
+  bool changed = update_ip ();
+
+  changed |= update_ssid ();
+
+  sys_sampler_read (sys_src, SYS_NUM_SOURCES);
+  if (sys_src[SYS_CPU_TEMP].valid) {
+    double tempC = sys_src[SYS_CPU_TEMP].value / 1000.0;
+    // Update if temp changed by >= 0.5 C
+    if (fabs (tempC - mon.tempC) >= 0.5) {
+      changed = true;
+      mon.tempC = tempC;
+    }
   }
+
+  unsigned long up = sys_src[SYS_UPTIME].valid ? (sys_src[SYS_UPTIME].value + 50) / 100 : 0;
+  fmt_uptime (mon.uptime, sizeof mon.uptime, up);
+  return changed;
+}
+
+static void
+sysinfo_timer (int fd, uint32_t expirations, void *arg)
+{
+  if (read_sysinfo () && mon.diag_ticks == 0)
+    show_status ();
+}
+
+static void
+status_tick (int fd, uint32_t expirations, void *arg)
+{
+  bool changed = false;
+
+  mon.bat_valid = 0;
+  if (ina260_online) {          // check if ina260 is connedted. 
+    for (int i = 0; i < NUM_RAILS; i++) {
+      if (rails[i].online)
+        get_ina260_status (&rails[i]);
+    }
+    if (rails[0].win.count > 0) {
+      mon.bat = rails[0].win.last;
+      mon.bat_valid = 1;
+    }
+    update_sparklines (&rails[0].win, mon.tick_cntr);
+    energy_update ();
+    energy_get (&mon.energy);
+    if (mon.tick_cntr % ENERGY_SAVE_TICKS == 0)
+      energy_save ();
+    // sound_enabled is decided by the fault checks below; clearing it here
+    // would briefly silence an alarm the ALERT callback just raised
+
+    bool alarm = false;
+    for (int i = 0; i < NUM_RAILS; i++) {
+      if (rails[i].online && check_rail (&rails[i], &changed))
+        alarm = true;
+    }
+    sound_set (alarm);
+  }
+  else {
+    snprintf (rails[0].status, sizeof (rails[0].status), "%s: off line", rails[0].name);
+  }
+
+  if (mon.diag_ticks > 0) {
+    // Hold the diagnostic page, then force a status redraw
+    if (--mon.diag_ticks == 0)
+      show_status ();
+  }
+  else if (changed) {
+    show_status ();
+  }
+  else {
+    // Still refresh once every ~10 ticks to keep uptime current
+    mon.idle_ticks = (mon.idle_ticks + 1) % 10;
+    if (mon.idle_ticks == 0)
+      show_status ();
+  }
+  status_page_tick ();
+  mon.tick_cntr++;
+}
+
+static void
+signal_received (int signo, void *arg)
+{
+  if (signo == SIGUSR1) {
+    // kill -USR1 <pid>: dump I2C bus stats to stdout and show them on the OLED
+    i2c_bus_stats_dump (stdout);
+    draw_i2c_diag_screen ();
+    mon.diag_ticks = I2C_DIAG_TICKS;
+  }
+  else {
+    evloop_stop ();
+  }
+}
+
+static void
+usage (const char *prog)
+{
+  fprintf (stderr, "usage: %s [--virtual [--pbm DIR] [--every-frame]]\n"
+           "  --virtual      no hardware: render into memory and shm %s\n"
+           "  --pbm DIR      also write each changed frame to DIR/frame_NNNNNN.pbm\n"
+           "  --every-frame  publish every update, not only changed ones\n", prog, OLED_VIRTUAL_SHM);
 }
 
-// ======== Main loop ========
 int
-main (void)
+main (int argc, char **argv)
 {
-  signal (SIGINT, sigint_handler);
-  signal (SIGTERM, sigint_handler);
+  int headless = 0;
+  struct ssd1306_virtual_config vcfg = {.shm_name = OLED_VIRTUAL_SHM };
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp (argv[i], "--virtual") == 0)
+      headless = 1;
+    else if (strcmp (argv[i], "--pbm") == 0 && i + 1 < argc)
+      vcfg.pbm_dir = argv[++i];
+    else if (strcmp (argv[i], "--every-frame") == 0)
+      vcfg.every_frame = 1;
+    else {
+      usage (argv[0]);
+      return 1;
+    }
+  }
+
+  // Signals go to the event loop; set up before any thread starts so
+  // every thread inherits the blocked mask
+  static const int sigs[] = { SIGINT, SIGTERM, SIGUSR1 };
+  if (evloop_init () < 0 || evloop_add_signals (sigs, 3, signal_received, NULL) < 0)
+    return 1;
 
-  if (is_raspberry_pi ()) {
+  if (headless) {
+    printf ("Headless: virtual display, no sensors or GPIO.\n");
+  }
+  else if (is_raspberry_pi ()) {
     printf ("Running on a Raspberry Pi.\n");
   }
   else {
-    printf ("Not running on a Raspberry Pi. Bye\n");
+    printf ("Not running on a Raspberry Pi. Bye (--virtual runs without hardware)\n");
     return 1;
   }
 
-  pthread_t sound_tid;
-  // Create the background sound thread
-  if (pthread_create (&sound_tid, NULL, background_sound_thread, NULL) != 0) {
-    perror ("pthread_create error");
+  alarm_tfd = evloop_add_timer (0, 0, alarm_timer, NULL);
+  action_tfd = evloop_add_timer (0, 0, action_timer, NULL);
+  if (alarm_tfd < 0 || action_tfd < 0)
     return 1;
-  }
 
   ina260_online = 0;
-  if (ina260_setup () == 0) {
+  if (headless) {
+    // Battery values stay blank; the status page renders everything else
+  }
+  else if (ina260_setup () == 0) {
+    if (energy_init (ENERGY_STATE_PATH, ina260_acq_ring (rails[0].acq_idx)) < 0)
+      fprintf (stderr, "Energy state not fully loaded, lifetime totals may be incomplete.\n");
     ina260_online = 1;
   }
   else {
     fprintf (stderr, "ina260 init failed.\n");
   }
 
+  if (headless) {
+    ssd1306_virtual_configure (&vcfg);
+    ssd1306_set_transport (&ssd1306_virtual_transport);
+  }
+  else
+    ssd1306_set_transport (&OLED_TRANSPORT);
   if (ssd1306_init () < 0) {
     fprintf (stderr, "SSD1306 init failed.\n");
     return 1;
   }
-  if (gpio_init () < 0) {
+  status_page_init (INA260_mV_TO_RAW (SPARK_VOLTAGE_LO_MV), INA260_mV_TO_RAW (SPARK_VOLTAGE_HI_MV),
+                    INA260_mA_TO_RAW (SPARK_CURRENT_HI_MA));
+  // Display pushes run on their own thread; drawing never waits on the bus
+  if (ssd1306_start_render_thread () < 0)
+    fprintf (stderr, "SSD1306 render thread failed, updating synchronously.\n");
+  if (!headless && gpio_init () < 0) {
     fprintf (stderr, "GPIO init failed.\n");
     return 1;
   }
+  if (ina260_hw_alert && ina260_alert_init (INA260_ALERT_PIN, ina260_alert_fault) != 0) {
+    fprintf (stderr, "INA260 ALERT watch failed, using software fault checks only.\n");
+    ina260_hw_alert = 0;
+  }
 
-  char hostname[50];
-  get_hostname (hostname, sizeof (hostname));
+  get_hostname (mon.hostname, sizeof (mon.hostname));
 #if 0
   simple_logf ("Service started. Button GPIO%d, LED GPIO%d, OLED on %s addr 0x%02X",
                BUTTON_PIN, LED_PIN, OLED_I2C_DEV, OLED_ADDR);
 #endif
 
   // Startup LED blink & bell
-  sound_enabled = true;
-  sleep (1);
-  sound_enabled = false;
-
+  for (int i = 0; i < 2; i++) {
+    rover_pin_drv_set_red (1);
+    rover_pin_drv_set_buzzer (1);
+    usleep (ALARM_HALF_PERIOD_MS * 1000);
+    rover_pin_drv_set_red (0);
+    rover_pin_drv_set_buzzer (0);
+    usleep (ALARM_HALF_PERIOD_MS * 1000);
+  }
   rover_pin_drv_set_green (0);
-  rover_pin_drv_set_red (0);
-  rover_pin_drv_set_buzzer (0);
-
-  char ip[64] = { 0 }, last_ip[64] = { 0 };
-  char ssid[64] = { 0 }, last_ssid[64] = { 0 };
-  double tempC = 0.0, last_tempC = -999.0;
-  float voltage_mv = 0.0, current_ma = 0.0;
-  char upbuf[32] = { 0 };
-  int tick_cntr = 0;
-
-  // Initial read
-  get_ip_address (ip, sizeof ip);
-  if (get_wifi_ssid (ssid, sizeof ssid) != 0)
-    strncpy (ssid, "—", sizeof ssid);
-  get_cpu_temp_c (&tempC);
-  fmt_uptime (upbuf, sizeof upbuf);
-  get_ina260_status (&voltage_mv, &current_ma);
-
-  draw_status_screen (hostname, ip, ssid, tempC, upbuf, voltage_mv, current_ma);
-  strncpy (last_ip, ip, sizeof last_ip);
-  strncpy (last_ssid, ssid, sizeof last_ssid);
-  last_tempC = tempC;
-
-  // Main loop: refresh every ~1s, handle button events
-  while (keepRunning) {
-    // Periodic screen refresh
-    bool changed = false;
-
-    if (get_ip_address (ip, sizeof ip) == 0) {
-      if (strcmp (ip, last_ip) != 0) {
-        changed = true;
-        strncpy (last_ip, ip, sizeof last_ip);
-      }
-    }
-    else {
-      if (strcmp (last_ip, "—") != 0) {
-        strncpy (last_ip, "—", sizeof last_ip);
-        changed = true;
-      }
-    }
-
-    if (get_wifi_ssid (ssid, sizeof ssid) == 0) {
-      if (strcmp (ssid, last_ssid) != 0) {
-        changed = true;
-        strncpy (last_ssid, ssid, sizeof last_ssid);
-      }
-    }
-    else {
-      if (strcmp (last_ssid, "—") != 0) {
-        strncpy (last_ssid, "—", sizeof last_ssid);
-        changed = true;
-      }
-    }
-
-    if (get_cpu_temp_c (&tempC) == 0) {
-      // Update if temp changed by >= 0.5 C
-      if (fabs (tempC - last_tempC) >= 0.5) {
-        changed = true;
-        last_tempC = tempC;
-      }
-    }
 
-    fmt_uptime (upbuf, sizeof upbuf);
-
-    voltage_mv = 0.0;
-    current_ma = 0.0;
-    if (ina260_online) {        // check if ina260 is connedted. 
-      get_ina260_status (&voltage_mv, &current_ma);     // ina260_str
-//            printf("Volts: %3.3fmV, Current: %3.3fmA\n", voltage_mv, current_ma);
-      sound_enabled = false;
-    }
-    else {
-//            printf("Status:ina260 off line\n");
-      strcpy (status_line, "Status:ina260 off line");
-    }
+  // IP changes arrive as netlink events; fall back to polling without them
+  net_fd = net_watch_open ();
+  if (net_fd >= 0 && evloop_add_fd (net_fd, EPOLLIN, net_ready, NULL) < 0) {
+    net_watch_close ();
+    net_fd = -1;
+  }
+  if (net_fd < 0)
+    fprintf (stderr, "rtnetlink watch failed, polling for the IP address.\n");
+
+  // The SSID is re-read on association events only
+  wifi_fd = wifi_watch_open (NULL);
+  if (wifi_fd >= 0 && evloop_add_fd (wifi_fd, EPOLLIN, wifi_ready, NULL) < 0) {
+    wifi_watch_close ();
+    wifi_fd = -1;
+  }
+  if (wifi_fd < 0)
+    fprintf (stderr, "nl80211 unavailable, no Wi-Fi SSID.\n");
 
-    if (ina260_online == 1) {
-      if ((voltage_mv < VOLATGE_LOW_LIMIT) && (tick_cntr & 1)) {
-        //    printf("Voltage fault: %3.3f V\n",voltage_mv);
-        sound_enabled = true;
-        changed = true;         // ??
-        strcpy (status_line, "Under Voltage Fault");
-        // Should we do something else here? ie shut down ROS2??
-      }
-      else if ((voltage_mv > VOLATGE_HIGH_LIMIT) && (tick_cntr & 1)) {
-        sound_enabled = true;
-        strcpy (status_line, "Over Voltage Fault");
-        // Should we do something else here? ie shut down ROS2??
-      }
-      else if ((current_ma > CURRENT_HIGH_LIMIT) && (tick_cntr & 1)) {
-        sound_enabled = true;
-        strcpy (status_line, "Over Current Fault");
-        // Should we do something else here? ie shut down ROS2??
-      }
-      else {
-        sound_enabled = false;
-        strcpy (status_line, "Status: Okay");
-      }
-    }
+  sys_sampler_open (sys_src, SYS_NUM_SOURCES);
 
-    if (changed) {
-      draw_status_screen (hostname, last_ip, last_ssid, last_tempC, upbuf, voltage_mv, current_ma);
-    }
-    else {
-      // Still refresh once every ~10 seconds to keep uptime current
-      static int counter = 0;
-      counter = (counter + 1) % 10;
-      if (counter == 0)
-        draw_status_screen (hostname, last_ip, last_ssid, last_tempC, upbuf, voltage_mv, current_ma);   // 1200.0, 500.0);
+  // Initial read
+  mon.tempC = -999.0;
+  read_sysinfo ();
+  if (ina260_online) {
+    struct ina260_sample s;
+    usleep (2 * ina260_conversion_period_us (&rails[0].dev.cfg));       // let the first sample land
+    if (sample_ring_latest (ina260_acq_ring (rails[0].acq_idx), &s) == 0) {
+      mon.bat = s;
+      mon.bat_valid = 1;
     }
-    tick_cntr++;
-    usleep (300 * 1000);
   }
+  show_status ();
 
+  // Sleep until a timer, button or signal needs us
+  if (evloop_add_timer (TICK_MS, TICK_MS, status_tick, NULL) < 0
+      || evloop_add_timer (SYSINFO_MS, SYSINFO_MS, sysinfo_timer, NULL) < 0)
+    return 1;
+  evloop_run ();
+
+  sound_set (false);
+  ina260_alert_shutdown ();
+  ina260_acq_stop ();
+  if (ina260_online) {
+    struct energy_totals energy;
+    energy_update ();
+    energy_get (&energy);
+    simple_logf ("Energy this run: %.1f mAh, %.3f Wh; lifetime: %.1f mAh, %.3f Wh",
+                 energy.run_mAh, energy.run_mWh / 1000.0, energy.life_mAh,
+                 energy.life_mWh / 1000.0);
+    energy_save ();
+  }
   gpio_cleanup ();
   rover_pin_drv_shutdown ();
   ssd1306_shutdown ();
+  i2c_bus_close ();
+  sys_sampler_close (sys_src, SYS_NUM_SOURCES);
+  wifi_watch_close ();
+  net_watch_close ();
+  evloop_close ();
+  if (headless) {
+    struct ssd1306_virtual_stats vs;
+    ssd1306_virtual_get_stats (&vs);
+    printf ("virtual display: %lu updates, %lu changed, %lu xfers, %lu bytes (%.1f bytes/update), %lu pbm files\n",
+            vs.updates, vs.changed, vs.xfers, vs.bytes,
+            vs.updates ? (double) vs.bytes / vs.updates : 0.0, vs.pbm_files);
+  }
   return 0;
 }
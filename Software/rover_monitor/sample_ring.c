@@ -0,0 +1,91 @@
+/* sample_ring.c
+ *
+ * SPMC ring buffer with a sequence number per slot (seqlock style).
+ * The writer marks a slot odd while filling it and stamps it with
+ * 2*(n+1) when sample n is complete. A reader copies the slot and
+ * accepts it only if the sequence was the expected even value both
+ * before and after the copy.
+ */
+
+#include "sample_ring.h"
+
+#include <string.h>
+
+#define RING_MASK (SAMPLE_RING_SIZE - 1)
+
+_Static_assert((SAMPLE_RING_SIZE & RING_MASK) == 0, "SAMPLE_RING_SIZE must be a power of two");
+
+void sample_ring_init(struct sample_ring *r) {
+    atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+    for (int i = 0; i < SAMPLE_RING_SIZE; i++)
+        atomic_store_explicit(&r->slot[i].seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void sample_ring_push(struct sample_ring *r, const struct ina260_sample *s) {
+    uint64_t n = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct sample_ring_slot *slot = &r->slot[n & RING_MASK];
+
+    atomic_store_explicit(&slot->seq, 2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->s, s, sizeof(*s));
+    atomic_store_explicit(&slot->seq, 2 * (n + 1), memory_order_release);
+    atomic_store_explicit(&r->head, n + 1, memory_order_release);
+}
+
+/* Copy sample n out of the ring. Returns 0 on success, -1 if it was
+ * overwritten (or is being overwritten) by the producer.
+ */
+static int _read_slot(struct sample_ring *r, uint64_t n, struct ina260_sample *out) {
+    struct sample_ring_slot *slot = &r->slot[n & RING_MASK];
+
+    uint64_t s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (s1 != 2 * (n + 1))
+        return -1;
+    memcpy(out, &slot->s, sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t s2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    return (s1 == s2) ? 0 : -1;
+}
+
+void sample_ring_reader_init(struct sample_ring *r, struct sample_ring_reader *rd) {
+    rd->pos = atomic_load_explicit(&r->head, memory_order_acquire);
+    rd->lost = 0;
+}
+
+int sample_ring_read(struct sample_ring *r, struct sample_ring_reader *rd,
+                     struct ina260_sample *out, int max) {
+    int n = 0;
+
+    while (n < max) {
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (rd->pos == head)
+            break;
+
+        /* Fell too far behind: skip to the oldest sample still in the ring */
+        if (head - rd->pos > SAMPLE_RING_SIZE) {
+            rd->lost += head - rd->pos - SAMPLE_RING_SIZE;
+            rd->pos = head - SAMPLE_RING_SIZE;
+        }
+
+        if (_read_slot(r, rd->pos, &out[n]) != 0) {
+            /* Overwritten while we were copying it */
+            rd->lost++;
+            rd->pos++;
+            continue;
+        }
+        rd->pos++;
+        n++;
+    }
+    return n;
+}
+
+int sample_ring_latest(struct sample_ring *r, struct ina260_sample *out) {
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (head == 0)
+            return -1;
+        if (_read_slot(r, head - 1, out) == 0)
+            return 0;
+    }
+}
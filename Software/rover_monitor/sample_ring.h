@@ -0,0 +1,63 @@
+/* sample_ring.h
+ *
+ * Single-producer / multi-consumer lock-free ring of INA260 samples.
+ * The producer never blocks and never waits for readers; a reader that
+ * falls more than SAMPLE_RING_SIZE samples behind skips forward and the
+ * skipped samples are counted in its 'lost' field.
+ */
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "ina260.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Must be a power of two. 1024 samples is ~2 s at the fastest INA260 rate. */
+#ifndef SAMPLE_RING_SIZE
+#define SAMPLE_RING_SIZE 1024
+#endif
+
+struct sample_ring_slot {
+    _Atomic uint64_t seq;           /* 2*(n+1) when sample n is complete, odd while writing */
+    struct ina260_sample s;
+};
+
+struct sample_ring {
+    _Atomic uint64_t head;          /* number of samples ever pushed */
+    struct sample_ring_slot slot[SAMPLE_RING_SIZE];
+};
+
+/* Per-consumer cursor. Each consumer owns its own reader. */
+struct sample_ring_reader {
+    uint64_t pos;                   /* next sample number to read */
+    uint64_t lost;                  /* samples overwritten before this reader got to them */
+};
+
+void sample_ring_init(struct sample_ring *r);
+
+/* Producer side. Only one thread may push. */
+void sample_ring_push(struct sample_ring *r, const struct ina260_sample *s);
+
+/* Start a reader at the current head (only samples pushed from now on). */
+void sample_ring_reader_init(struct sample_ring *r, struct sample_ring_reader *rd);
+
+/* Copy up to max samples not yet seen by rd into out, oldest first.
+ * Returns the number of samples copied.
+ */
+int sample_ring_read(struct sample_ring *r, struct sample_ring_reader *rd,
+                     struct ina260_sample *out, int max);
+
+/* Copy the newest sample into out. Returns 0 on success, -1 if the ring is empty. */
+int sample_ring_latest(struct sample_ring *r, struct ina260_sample *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SAMPLE_RING_H */
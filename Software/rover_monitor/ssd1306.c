@@ -1,135 +1,205 @@
 /*
- * ssd1306.c - Minimal SSD1306 128x64 I2C framebuffer driver
+ * ssd1306.c - Minimal SSD1306 128x64 framebuffer driver
  * Extracted from rover_monitor_12.c and made reusable.
+ * The bytes go out through a transport (ssd1306_transport.h): I2C by
+ * default, or SPI.
  */
 
 #include "ssd1306.h"
+#include "ssd1306_transport.h"
 
 #include <errno.h>
-#include <fcntl.h>
-#include <linux/i2c-dev.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
-#ifndef OLED_I2C_DEV
-#define OLED_I2C_DEV   "/dev/i2c-1"
-#endif
+static const struct ssd1306_transport *xport = &ssd1306_i2c_transport;
+static int xport_open = 0;
 
-#ifndef OLED_ADDR
-#define OLED_ADDR      0x3c
-#endif
+// Triple buffering. Producers draw into the back frame (oled_buf) while
+// holding draw_lock; ssd1306_update() publishes it by swapping it with the
+// ready slot. The render thread swaps the ready slot with its front frame
+// and pushes that. Nobody waits for the bus but the render thread, and a
+// frame published before the previous one was taken replaces it.
+#define FRAME_FRESH 4           // set in ready_idx when it holds an unsent frame
 
-static int i2c_fd = -1;
-static uint8_t oled_buf[SSD1306_BUF_SZ];
+// Each frame carries a dirty hint: the columns drawn on each page since
+// it became the back frame. Only hinted columns are compared against the
+// shadow and sent. A hint may cover more than changed, never less.
+struct dirty_map
+{
+  uint8_t c0[SSD1306_PAGES];    // c0 > c1: page untouched
+  uint8_t c1[SSD1306_PAGES];
+};
 
-//static int i2c_fd = -1;
-// static uint8_t oled_buf[SSD1306_BUF_SZ];
+static uint8_t frames[3][SSD1306_BUF_SZ];
+static struct dirty_map frame_dirty[3];
+static uint8_t *oled_buf = frames[0];
+static struct dirty_map *oled_dirty = &frame_dirty[0];
+static int back_idx = 0;                        // producers, under draw_lock
+static int front_idx = 2;                       // render thread
+static _Atomic int ready_idx = 1;
+
+static pthread_mutex_t draw_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t render_tid;
+static int render_running = 0;
+static volatile int render_stop = 0;
+static _Atomic unsigned long frames_dropped = 0;
+static _Atomic unsigned long push_errors = 0;
+
+// What the panel's RAM holds: a copy of the last frame that was sent
+// successfully. Only bytes that differ from it are pushed. shadow_valid
+// has a bit per page; a clear bit means that page's contents are unknown
+// (after init, a failed transfer or a hardware scroll) and it is resent
+// in full.
+#define SHADOW_ALL_VALID 0xFF
+static uint8_t shadow_buf[SSD1306_BUF_SZ];
+static uint8_t shadow_valid = 0;
+
+static const struct dirty_map no_dirty = {
+  .c0 = {[0 ... SSD1306_PAGES - 1] = SSD1306_WIDTH},
+};
 
+// Hardware scroll. Producers set scroll_req (under wake_lock); the pusher
+// applies it, since the panel must not scroll while its RAM is written:
+// any push stops the scroll, rewrites the scrolled pages and restarts it.
+// The restart would jump back to the unscrolled image, so the pages are
+// written rotated by the distance scrolled since the request started.
+struct scroll_cfg
+{
+  bool on;
+  uint8_t cmd;                  // 0x26 right, 0x27 left
+  uint8_t p0, p1;
+  uint8_t step;
+};
+static struct scroll_cfg scroll_req;    // wake_lock
+static unsigned scroll_req_seq = 0;     // wake_lock, bumped on every request
+static struct scroll_cfg scroll_hw;     // pusher: what the panel runs
+static unsigned scroll_hw_seq = 0;      // pusher: last request applied
+static struct timespec scroll_epoch;    // pusher: when that request started
+static uint8_t rot_buf[SSD1306_BUF_SZ]; // pusher: frame with scrolled pages rotated
+
+// Frames per one column step, indexed by the step code
+static const unsigned int scroll_step_frames[8] = { 5, 64, 128, 256, 3, 4, 25, 2 };
+
+// Init sequence (typical), sent as a single command stream
+static const uint8_t oled_init_seq[] = {
+  0xAE,                         // display off
+  0xD5, 0x80,                   // clock divide
+  0xA8, 0x3F,                   // multiplex
+  0xD3, 0x00,                   // display offset
+  0x40,                         // start line
+  0x8D, 0x14,                   // charge pump
+  0x20, 0x00,                   // memory mode: horizontal
+  // rotated the disply around
+  0xA1,                         // seg remap, cmd 0xA0 sets the segment remap to normal, while 0xA1 reverses it.
+  0xC8,                         // COM scan dec, cmd 0xC0 sets the scan direction to normal, while 0xC8 reverses it.
+  0xDA, 0x12,                   // compins
+  0x81, 0xCF,                   // contrast
+  0xD9, 0xF1,                   // precharge
+  0xDB, 0x40,                   // vcom detect
+  0xA4,                         // entire display on (resume)
+  0xA6,                         // normal display
+  0xAF                          // display on
+};
+
+// Sequences longer than SSD1306_CMD_MAX must be split by the caller
 static int
-i2c_open_dev (const char *dev, int addr)
+ssd1306_cmds (const uint8_t *cmds, size_t n)
 {
-  int fd = open (dev, O_RDWR);
-  if (fd < 0)
-    return -1;
-  if (ioctl (fd, I2C_SLAVE, addr) < 0) {
-    close (fd);
+  if (n > SSD1306_CMD_MAX)
     return -1;
-  }
-  return fd;
+  return xport->cmds (cmds, n);
 }
 
+// Write columns c0..c1 of one page of frame
 static int
-ssd1306_cmd (uint8_t c)
+ssd1306_push_span (const uint8_t *frame, int page, int c0, int c1)
 {
-  uint8_t buf[2] = { 0x00, c }; // control byte 0x00 = command
-  if (write (i2c_fd, buf, 2) != 2)
-    return -1;
-  return 0;
+  return xport->span (page, c0, c1, &frame[page * SSD1306_WIDTH + c0]);
 }
 
-static int
-ssd1306_cmd2 (uint8_t c1, uint8_t c2)
+static void
+dirty_reset (struct dirty_map *d)
 {
-  if (ssd1306_cmd (c1) < 0)
-    return -1;
-  if (ssd1306_cmd (c2) < 0)
-    return -1;
-  return 0;
+  memset (d->c0, SSD1306_WIDTH, sizeof (d->c0));
+  memset (d->c1, 0, sizeof (d->c1));
 }
 
-static int
-ssd1306_data (const uint8_t *data, size_t len)
-{
-  // Send as chunks prefixed with 0x40 control byte.
-  uint8_t chunk[17];
-  chunk[0] = 0x40;
-  while (len > 0) {
-    size_t n = len > 16 ? 16 : len;
-    memcpy (&chunk[1], data, n);
-    if (write (i2c_fd, chunk, n + 1) != (ssize_t) (n + 1))
-      return -1;
-    data += n;
-    len -= n;
+// Add columns x0..x1 of page; caller has clipped them
+static inline void
+dirty_add (struct dirty_map *d, int page, int x0, int x1)
+{
+  if (x0 < d->c0[page])
+    d->c0[page] = x0;
+  if (x1 > d->c1[page])
+    d->c1[page] = x1;
+}
+
+static void
+dirty_union (struct dirty_map *d, const struct dirty_map *s)
+{
+  for (int page = 0; page < SSD1306_PAGES; page++) {
+    if (s->c0[page] <= s->c1[page])
+      dirty_add (d, page, s->c0[page], s->c1[page]);
   }
-  return 0;
+}
+
+void
+ssd1306_mark_dirty (int x, int y, int w, int h)
+{
+  int x1 = x + w - 1, y1 = y + h - 1;
+  if (x < 0)
+    x = 0;
+  if (y < 0)
+    y = 0;
+  if (x1 >= SSD1306_WIDTH)
+    x1 = SSD1306_WIDTH - 1;
+  if (y1 >= SSD1306_HEIGHT)
+    y1 = SSD1306_HEIGHT - 1;
+  if (x > x1 || y > y1)
+    return;
+  for (int page = y / 8; page <= y1 / 8; page++)
+    dirty_add (oled_dirty, page, x, x1);
+}
+
+void
+ssd1306_set_transport (const struct ssd1306_transport *t)
+{
+  if (!xport_open && t)
+    xport = t;
 }
 
 int
 ssd1306_init (void)
 {
-  if ((i2c_fd = i2c_open_dev (OLED_I2C_DEV, OLED_ADDR)) < 0) {
-    perror ("i2c_open_dev");
-    return -1;
+  if (!xport_open) {
+    if (xport->open () < 0)
+      return -1;
+    xport_open = 1;
   }
-  // Init sequence (typical)
-  if (ssd1306_cmd (0xAE) < 0)
-    return -1;                  // display off
-  if (ssd1306_cmd2 (0xD5, 0x80) < 0)
-    return -1;                  // clock divide
-  if (ssd1306_cmd2 (0xA8, 0x3F) < 0)
-    return -1;                  // multiplex
-  if (ssd1306_cmd2 (0xD3, 0x00) < 0)
-    return -1;                  // display offset
-  if (ssd1306_cmd (0x40) < 0)
-    return -1;                  // start line
-  if (ssd1306_cmd2 (0x8D, 0x14) < 0)
-    return -1;                  // charge pump
-  if (ssd1306_cmd2 (0x20, 0x00) < 0)
-    return -1;                  // memory mode: horizontal
-
-  // rotated the disply around
-  if (ssd1306_cmd (0xA1) < 0)
-    return -1;                  // seg remap, cmd 0xA0 sets the segment remap to normal, while 0xA1 reverses it.
-  if (ssd1306_cmd (0xC8) < 0)
-    return -1;                  // COM scan dec, cmd 0xC0 sets the scan direction to normal, while 0xC8 reverses it.
-
-  if (ssd1306_cmd2 (0xDA, 0x12) < 0)
-    return -1;                  // compins
-  if (ssd1306_cmd2 (0x81, 0xCF) < 0)
-    return -1;                  // contrast
-  if (ssd1306_cmd2 (0xD9, 0xF1) < 0)
-    return -1;                  // precharge
-  if (ssd1306_cmd2 (0xDB, 0x40) < 0)
-    return -1;                  // vcom detect
-  if (ssd1306_cmd (0xA4) < 0)
-    return -1;                  // entire display on (resume)
-  if (ssd1306_cmd (0xA6) < 0)
-    return -1;                  // normal display
-
-  if (ssd1306_cmd (0xAF) < 0)
-    return -1;                  // display on
-  memset (oled_buf, 0x00, sizeof (oled_buf));
+  if (ssd1306_cmds (oled_init_seq, sizeof (oled_init_seq)) < 0)
+    return -1;
+  memset (frames, 0x00, sizeof (frames));
+  for (int i = 0; i < 3; i++)
+    dirty_reset (&frame_dirty[i]);
+  shadow_valid = 0;
+  memset (&scroll_hw, 0, sizeof (scroll_hw));
   return 0;
 }
 
 void
 ssd1306_clear (void)
 {
-  memset (oled_buf, 0x00, sizeof (oled_buf));
+  memset (oled_buf, 0x00, SSD1306_BUF_SZ);
+  ssd1306_mark_dirty (0, 0, SSD1306_WIDTH, SSD1306_HEIGHT);
 }
 
 void
@@ -143,6 +213,7 @@ ssd1306_set_pixel (int x, int y, bool on)
     oled_buf[idx] |= bit;
   else
     oled_buf[idx] &= ~bit;
+  dirty_add (oled_dirty, y / 8, x, x);
 }
 
 void
@@ -152,166 +223,515 @@ ssd1306_hline (int x, int y, int w, bool on)
     ssd1306_set_pixel (x + i, y, on);
 }
 
+void
+ssd1306_fill_rect (int x, int y, int w, int h, bool on)
+{
+  int x1 = x + w, y1 = y + h;   // exclusive
+  if (x < 0)
+    x = 0;
+  if (y < 0)
+    y = 0;
+  if (x1 > SSD1306_WIDTH)
+    x1 = SSD1306_WIDTH;
+  if (y1 > SSD1306_HEIGHT)
+    y1 = SSD1306_HEIGHT;
+  if (x >= x1 || y >= y1)
+    return;
+
+  // One masked byte per column per page
+  for (int page = y / 8; page <= (y1 - 1) / 8; page++) {
+    int r0 = (page * 8 > y) ? 0 : y - page * 8;
+    int r1 = (page * 8 + 8 < y1) ? 8 : y1 - page * 8;
+    uint8_t mask = (uint8_t) ((0xFF << r0) & (0xFF >> (8 - r1)));
+    uint8_t *p = &oled_buf[page * SSD1306_WIDTH];
+    for (int col = x; col < x1; col++)
+      p[col] = on ? (p[col] | mask) : (p[col] & ~mask);
+    dirty_add (oled_dirty, page, x, x1 - 1);
+  }
+}
+
+void
+ssd1306_shift_left (int x, int y, int w, int h, int n)
+{
+  int x1 = x + w, y1 = y + h;   // exclusive
+  if (x < 0)
+    x = 0;
+  if (y < 0)
+    y = 0;
+  if (x1 > SSD1306_WIDTH)
+    x1 = SSD1306_WIDTH;
+  if (y1 > SSD1306_HEIGHT)
+    y1 = SSD1306_HEIGHT;
+  if (x >= x1 || y >= y1 || n <= 0)
+    return;
+  if (n > x1 - x)
+    n = x1 - x;
+
+  // Move whole column bytes, keeping the rows outside the box
+  for (int page = y / 8; page <= (y1 - 1) / 8; page++) {
+    int r0 = (page * 8 > y) ? 0 : y - page * 8;
+    int r1 = (page * 8 + 8 < y1) ? 8 : y1 - page * 8;
+    uint8_t mask = (uint8_t) ((0xFF << r0) & (0xFF >> (8 - r1)));
+    uint8_t *p = &oled_buf[page * SSD1306_WIDTH];
+    for (int col = x; col < x1 - n; col++)
+      p[col] = (p[col] & ~mask) | (p[col + n] & mask);
+    for (int col = x1 - n; col < x1; col++)
+      p[col] &= ~mask;
+    dirty_add (oled_dirty, page, x, x1 - 1);
+  }
+}
+
+// Send frame to the panel. Only the render thread (or the synchronous
+// path when it isn't running) calls this, so shadow_buf needs no lock.
+// Returns the number of spans sent, or -1 on error.
+static int
+ssd1306_push_frame (const uint8_t *frame, const struct dirty_map *dirty)
+{
+  int spans = 0;
+
+  // Send one span per page, from the first to the last changed column
+  // within the hinted range; every page in full if the panel contents
+  // are unknown
+  for (int page = 0; page < SSD1306_PAGES; page++) {
+    const uint8_t *cur = &frame[page * SSD1306_WIDTH];
+    uint8_t *old = &shadow_buf[page * SSD1306_WIDTH];
+    int c0 = 0, c1 = SSD1306_WIDTH - 1;
+
+    if (shadow_valid & (1 << page)) {
+      c0 = dirty->c0[page];
+      c1 = dirty->c1[page];
+      while (c0 <= c1 && cur[c0] == old[c0])
+        c0++;
+      if (c0 > c1)
+        continue;               // page unchanged
+      while (cur[c1] == old[c1])
+        c1--;
+    }
+
+    if (ssd1306_push_span (frame, page, c0, c1) < 0) {
+      shadow_valid = 0;         // panel state unknown, resend all next time
+      return -1;
+    }
+    memcpy (&old[c0], &cur[c0], c1 - c0 + 1);
+    shadow_valid |= 1 << page;
+    spans++;
+  }
+  return spans;
+}
+
+static int
+ssd1306_scroll_off (void)
+{
+  static const uint8_t stop[] = { 0x2E };
+
+  if (!scroll_hw.on)
+    return 0;
+  // Scrolling rotates the pages' RAM, so they must be rewritten
+  for (int page = scroll_hw.p0; page <= scroll_hw.p1; page++)
+    shadow_valid &= ~(1 << page);
+  scroll_hw.on = false;
+  return ssd1306_cmds (stop, sizeof (stop));
+}
+
+static int
+ssd1306_scroll_on (const struct scroll_cfg *c)
+{
+  uint8_t cmd[] = { c->cmd, 0x00, c->p0, c->step, c->p1, 0x00, 0xFF,
+    0x2F                        // activate
+  };
+
+  if (ssd1306_cmds (cmd, sizeof (cmd)) < 0)
+    return -1;
+  scroll_hw = *c;
+  return 0;
+}
+
+// Columns the panel has scrolled since the request started (estimated)
+static int
+ssd1306_scroll_phase (const struct scroll_cfg *req)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  int64_t ms = (int64_t) (now.tv_sec - scroll_epoch.tv_sec) * 1000 +
+    (now.tv_nsec - scroll_epoch.tv_nsec) / 1000000;
+  return (int) (ms * SSD1306_FRAME_HZ / (scroll_step_frames[req->step & 7] * 1000) %
+                SSD1306_WIDTH);
+}
+
+// Bring the panel up to date with frame and scroll request number seq
+static int
+ssd1306_present (const uint8_t *frame, const struct dirty_map *dirty,
+                 const struct scroll_cfg *req, unsigned seq)
+{
+  if (seq != scroll_hw_seq) {
+    scroll_hw_seq = seq;
+    clock_gettime (CLOCK_MONOTONIC, &scroll_epoch);
+  }
+  if (ssd1306_scroll_off () < 0)
+    return -1;
+
+  bool scroll = req->on && xport->can_scroll;
+  int k = scroll ? ssd1306_scroll_phase (req) : 0;
+  if (k) {
+    // Left scroll shows column c + k at c after k steps; right, c - k
+    int shift = (req->cmd == SSD1306_SCROLL_LEFT) ? k : SSD1306_WIDTH - k;
+    memcpy (rot_buf, frame, SSD1306_BUF_SZ);
+    for (int page = req->p0; page <= req->p1; page++) {
+      const uint8_t *src = &frame[page * SSD1306_WIDTH];
+      uint8_t *dst = &rot_buf[page * SSD1306_WIDTH];
+      memcpy (dst, src + shift, SSD1306_WIDTH - shift);
+      memcpy (dst + SSD1306_WIDTH - shift, src, shift);
+    }
+    frame = rot_buf;
+  }
+
+  int spans = ssd1306_push_frame (frame, dirty);
+  if (spans < 0)
+    return -1;
+  if (scroll && ssd1306_scroll_on (req) < 0)
+    return -1;
+  if (xport->flush)
+    xport->flush (spans > 0);
+  return 0;
+}
+
+// Take the newest published frame, if any, and push it; or re-push the
+// current one if only the scroll request changed.
+// Returns 1 if the panel was updated, 0 if nothing was waiting, -1 on error.
+static int
+ssd1306_render_once (void)
+{
+  struct scroll_cfg req;
+  unsigned seq;
+
+  pthread_mutex_lock (&wake_lock);
+  req = scroll_req;
+  seq = scroll_req_seq;
+  pthread_mutex_unlock (&wake_lock);
+
+  const struct dirty_map *dirty = &no_dirty;
+  if (atomic_load (&ready_idx) & FRAME_FRESH) {
+    int prev = atomic_exchange (&ready_idx, front_idx);
+    front_idx = prev & 3;
+    dirty = &frame_dirty[front_idx];
+  }
+  else if (seq == scroll_hw_seq)
+    return 0;
+
+  if (ssd1306_present (frames[front_idx], dirty, &req, seq) < 0) {
+    atomic_fetch_add (&push_errors, 1);
+    return -1;
+  }
+  return 1;
+}
+
+static void *
+ssd1306_render_thread (void *arg)
+{
+  (void) arg;
+  while (!render_stop) {
+    pthread_mutex_lock (&wake_lock);
+    while (!render_stop && !(atomic_load (&ready_idx) & FRAME_FRESH)
+           && scroll_req_seq == scroll_hw_seq)
+      pthread_cond_wait (&wake_cond, &wake_lock);
+    pthread_mutex_unlock (&wake_lock);
+    ssd1306_render_once ();
+  }
+  ssd1306_render_once ();       // flush the last frame
+  return NULL;
+}
+
+int
+ssd1306_start_render_thread (void)
+{
+  if (render_running)
+    return 0;
+  render_stop = 0;
+  if (pthread_create (&render_tid, NULL, ssd1306_render_thread, NULL) != 0)
+    return -1;
+  render_running = 1;
+  return 0;
+}
+
+void
+ssd1306_stop_render_thread (void)
+{
+  if (!render_running)
+    return;
+  pthread_mutex_lock (&wake_lock);
+  render_stop = 1;
+  pthread_cond_signal (&wake_cond);
+  pthread_mutex_unlock (&wake_lock);
+  pthread_join (render_tid, NULL);
+  render_running = 0;
+}
+
+void
+ssd1306_lock (void)
+{
+  pthread_mutex_lock (&draw_lock);
+}
+
+void
+ssd1306_unlock (void)
+{
+  pthread_mutex_unlock (&draw_lock);
+}
+
+unsigned long
+ssd1306_frames_dropped (void)
+{
+  return atomic_load (&frames_dropped);
+}
+
+unsigned long
+ssd1306_push_errors (void)
+{
+  return atomic_load (&push_errors);
+}
+
 int
 ssd1306_update (void)
 {
-  if (ssd1306_cmd2 (0x21, 0x00) < 0)
-    return -1;                  // set column addr: start 0
-  if (ssd1306_cmd (0x7F) < 0)
-    return -1;                  // end 127
-  if (ssd1306_cmd2 (0x22, 0x00) < 0)
-    return -1;                  // set page addr: start 0
-  if (ssd1306_cmd (0x07) < 0)
-    return -1;                  // end 7
-  return ssd1306_data (oled_buf, sizeof (oled_buf));
+  if (!render_running) {
+    int rc = ssd1306_present (oled_buf, oled_dirty, &scroll_req, scroll_req_seq);
+    dirty_reset (oled_dirty);
+    return rc;
+  }
+
+  // Publish the back frame and take over the one it replaces. If that one
+  // was never sent its hint is folded into ours first; the render thread
+  // doesn't write hints, so reading it is safe even if it gets taken
+  // meanwhile (the CAS then fails and the extra columns are harmless).
+  int prev = atomic_load (&ready_idx);
+  do {
+    if (prev & FRAME_FRESH)
+      dirty_union (oled_dirty, &frame_dirty[prev & 3]);
+  } while (!atomic_compare_exchange_weak (&ready_idx, &prev, back_idx | FRAME_FRESH));
+  if (prev & FRAME_FRESH)
+    atomic_fetch_add (&frames_dropped, 1);      // never sent, superseded by this one
+  int next = prev & 3;
+
+  // Carry the published picture over, so drawing continues from it
+  memcpy (frames[next], oled_buf, SSD1306_BUF_SZ);
+  dirty_reset (&frame_dirty[next]);
+  back_idx = next;
+  oled_buf = frames[next];
+  oled_dirty = &frame_dirty[next];
+
+  pthread_mutex_lock (&wake_lock);
+  pthread_cond_signal (&wake_cond);
+  pthread_mutex_unlock (&wake_lock);
+  return 0;
+}
+
+static int
+ssd1306_request_scroll (const struct scroll_cfg *c)
+{
+  pthread_mutex_lock (&wake_lock);
+  scroll_req = *c;
+  scroll_req_seq++;
+  pthread_cond_signal (&wake_cond);
+  pthread_mutex_unlock (&wake_lock);
+
+  if (render_running)
+    return 0;
+  // Synchronous: apply now, re-pushing only what the scroll invalidates
+  return ssd1306_present (oled_buf, &no_dirty, c, scroll_req_seq);
+}
+
+int
+ssd1306_scroll_start (enum ssd1306_scroll_dir dir, int page0, int page1,
+                      enum ssd1306_scroll_step step)
+{
+  if (page0 < 0 || page1 >= SSD1306_PAGES || page0 > page1)
+    return -1;
+  struct scroll_cfg c = {.on = true,.cmd = dir,.p0 = page0,.p1 = page1,.step = step & 7 };
+  return ssd1306_request_scroll (&c);
+}
+
+int
+ssd1306_scroll_stop (void)
+{
+  struct scroll_cfg c = {.on = false };
+  return ssd1306_request_scroll (&c);
+}
+
+unsigned int
+ssd1306_scroll_period_ms (enum ssd1306_scroll_step step)
+{
+  return SSD1306_WIDTH * scroll_step_frames[step & 7] * 1000 / SSD1306_FRAME_HZ;
 }
 
 // 5x7 Font (ASCII 32..127), each char 5 columns, LSB = top pixel.
-// (Shortened comment; full table included.)
-static const uint8_t font5x7[96][5] = {
-  {0x00, 0x00, 0x00, 0x00, 0x00},       // 32 ' '
-  {0x00, 0x00, 0x5F, 0x00, 0x00},       // 33 '!'
-  {0x00, 0x07, 0x00, 0x07, 0x00},       // 34 '"'
-  {0x14, 0x7F, 0x14, 0x7F, 0x14},       // 35 '#'
-  {0x24, 0x2A, 0x7F, 0x2A, 0x12},       // 36 '$'
-  {0x23, 0x13, 0x08, 0x64, 0x62},       // 37 '%'
-  {0x36, 0x49, 0x55, 0x22, 0x50},       // 38 '&'
-  {0x00, 0x05, 0x03, 0x00, 0x00},       // 39 '''
-  {0x00, 0x1C, 0x22, 0x41, 0x00},       // 40 '('
-  {0x00, 0x41, 0x22, 0x1C, 0x00},       // 41 ')'
-  {0x14, 0x08, 0x3E, 0x08, 0x14},       // 42 '*'
-  {0x08, 0x08, 0x3E, 0x08, 0x08},       // 43 '+'
-  {0x00, 0x50, 0x30, 0x00, 0x00},       // 44 ','
-  {0x08, 0x08, 0x08, 0x08, 0x08},       // 45 '-'
-  {0x00, 0x60, 0x60, 0x00, 0x00},       // 46 '.'
-  {0x20, 0x10, 0x08, 0x04, 0x02},       // 47 '/'
-  {0x3E, 0x51, 0x49, 0x45, 0x3E},       // 48 '0'
-  {0x00, 0x42, 0x7F, 0x40, 0x00},       // 49 '1'
-  {0x42, 0x61, 0x51, 0x49, 0x46},       // 50 '2'
-  {0x21, 0x41, 0x45, 0x4B, 0x31},       // 51 '3'
-  {0x18, 0x14, 0x12, 0x7F, 0x10},       // 52 '4'
-  {0x27, 0x45, 0x45, 0x45, 0x39},       // 53 '5'
-  {0x3C, 0x4A, 0x49, 0x49, 0x30},       // 54 '6'
-  {0x01, 0x71, 0x09, 0x05, 0x03},       // 55 '7'
-  {0x36, 0x49, 0x49, 0x49, 0x36},       // 56 '8'
-  {0x06, 0x49, 0x49, 0x29, 0x1E},       // 57 '9'
-  {0x00, 0x36, 0x36, 0x00, 0x00},       // 58 ':'
-  {0x00, 0x56, 0x36, 0x00, 0x00},       // 59 ';'
-  {0x08, 0x14, 0x22, 0x41, 0x00},       // 60 '<'
-  {0x14, 0x14, 0x14, 0x14, 0x14},       // 61 '='
-  {0x00, 0x41, 0x22, 0x14, 0x08},       // 62 '>'
-  {0x02, 0x01, 0x51, 0x09, 0x06},       // 63 '?'
-  {0x32, 0x49, 0x79, 0x41, 0x3E},       // 64 '@'
-  {0x7E, 0x11, 0x11, 0x11, 0x7E},       // 65 'A'
-  {0x7F, 0x49, 0x49, 0x49, 0x36},       // 66 'B'
-  {0x3E, 0x41, 0x41, 0x41, 0x22},       // 67 'C'
-  {0x7F, 0x41, 0x41, 0x22, 0x1C},       // 68 'D'
-  {0x7F, 0x49, 0x49, 0x49, 0x41},       // 69 'E'
-  {0x7F, 0x09, 0x09, 0x09, 0x01},       // 70 'F'
-  {0x3E, 0x41, 0x49, 0x49, 0x7A},       // 71 'G'
-  {0x7F, 0x08, 0x08, 0x08, 0x7F},       // 72 'H'
-  {0x00, 0x41, 0x7F, 0x41, 0x00},       // 73 'I'
-  {0x20, 0x40, 0x41, 0x3F, 0x01},       // 74 'J'
-  {0x7F, 0x08, 0x14, 0x22, 0x41},       // 75 'K'
-  {0x7F, 0x40, 0x40, 0x40, 0x40},       // 76 'L'
-  {0x7F, 0x02, 0x0C, 0x02, 0x7F},       // 77 'M'
-  {0x7F, 0x04, 0x08, 0x10, 0x7F},       // 78 'N'
-  {0x3E, 0x41, 0x41, 0x41, 0x3E},       // 79 'O'
-  {0x7F, 0x09, 0x09, 0x09, 0x06},       // 80 'P'
-  {0x3E, 0x41, 0x51, 0x21, 0x5E},       // 81 'Q'
-  {0x7F, 0x09, 0x19, 0x29, 0x46},       // 82 'R'
-  {0x46, 0x49, 0x49, 0x49, 0x31},       // 83 'S'
-  {0x01, 0x01, 0x7F, 0x01, 0x01},       // 84 'T'
-  {0x3F, 0x40, 0x40, 0x40, 0x3F},       // 85 'U'
-  {0x1F, 0x20, 0x40, 0x20, 0x1F},       // 86 'V'
-  {0x3F, 0x40, 0x38, 0x40, 0x3F},       // 87 'W'
-  {0x63, 0x14, 0x08, 0x14, 0x63},       // 88 'X'
-  {0x07, 0x08, 0x70, 0x08, 0x07},       // 89 'Y'
-  {0x61, 0x51, 0x49, 0x45, 0x43},       // 90 'Z'
-  {0x00, 0x7F, 0x41, 0x41, 0x00},       // 91 '['
-  {0x02, 0x04, 0x08, 0x10, 0x20},       // 92 backslash
-  {0x00, 0x41, 0x41, 0x7F, 0x00},       // 93 ']'
-  {0x04, 0x02, 0x01, 0x02, 0x04},       // 94 '^'
-  {0x80, 0x80, 0x80, 0x80, 0x80},       // 95 '_'
-  {0x00, 0x01, 0x02, 0x04, 0x00},       // 96 '`'
-  {0x20, 0x54, 0x54, 0x54, 0x78},       // 97 'a'
-  {0x7F, 0x48, 0x44, 0x44, 0x38},       // 98 'b'
-  {0x38, 0x44, 0x44, 0x44, 0x20},       // 99 'c'
-  {0x38, 0x44, 0x44, 0x48, 0x7F},       // 100 'd'
-  {0x38, 0x54, 0x54, 0x54, 0x18},       // 101 'e'
-  {0x08, 0x7E, 0x09, 0x01, 0x02},       // 102 'f'
-  {0x0C, 0x52, 0x52, 0x52, 0x3E},       // 103 'g'
-  {0x7F, 0x08, 0x04, 0x04, 0x78},       // 104 'h'
-  {0x00, 0x44, 0x7D, 0x40, 0x00},       // 105 'i'
-  {0x20, 0x40, 0x44, 0x3D, 0x00},       // 106 'j'
-  {0x7F, 0x10, 0x28, 0x44, 0x00},       // 107 'k'
-  {0x00, 0x41, 0x7F, 0x40, 0x00},       // 108 'l'
-  {0x7C, 0x04, 0x18, 0x04, 0x78},       // 109 'm'
-  {0x7C, 0x08, 0x04, 0x04, 0x78},       // 110 'n'
-  {0x38, 0x44, 0x44, 0x44, 0x38},       // 111 'o'
-  {0x7C, 0x14, 0x14, 0x14, 0x08},       // 112 'p'
-  {0x08, 0x14, 0x14, 0x14, 0x7C},       // 113 'q'
-  {0x7C, 0x08, 0x04, 0x04, 0x08},       // 114 'r'
-  {0x48, 0x54, 0x54, 0x54, 0x20},       // 115 's'
-  {0x04, 0x3F, 0x44, 0x40, 0x20},       // 116 't'
-  {0x3C, 0x40, 0x40, 0x20, 0x7C},       // 117 'u'
-  {0x1C, 0x20, 0x40, 0x20, 0x1C},       // 118 'v'
-  {0x3C, 0x40, 0x30, 0x40, 0x3C},       // 119 'w'
-  {0x44, 0x28, 0x10, 0x28, 0x44},       // 120 'x'
-  {0x0C, 0x50, 0x50, 0x50, 0x3C},       // 121 'y'
-  {0x44, 0x64, 0x54, 0x4C, 0x44},       // 122 'z'
-  {0x08, 0x36, 0x41, 0x41, 0x00},       // 123 '{'
-  {0x00, 0x00, 0x7F, 0x00, 0x00},       // 124 '|'
-  {0x00, 0x41, 0x41, 0x36, 0x08},       // 125 '}'
-  {0x08, 0x04, 0x08, 0x10, 0x08}        // 126 '~'
+// Kept as an X-macro list so the table and its glyph metrics are both
+// generated from the same data at compile time.
+#define FONT5X7(X) \
+  X (0x00, 0x00, 0x00, 0x00, 0x00)      /* 32 ' ' */ \
+  X (0x00, 0x00, 0x5F, 0x00, 0x00)      /* 33 '!' */ \
+  X (0x00, 0x07, 0x00, 0x07, 0x00)      /* 34 '"' */ \
+  X (0x14, 0x7F, 0x14, 0x7F, 0x14)      /* 35 '#' */ \
+  X (0x24, 0x2A, 0x7F, 0x2A, 0x12)      /* 36 '$' */ \
+  X (0x23, 0x13, 0x08, 0x64, 0x62)      /* 37 '%' */ \
+  X (0x36, 0x49, 0x55, 0x22, 0x50)      /* 38 '&' */ \
+  X (0x00, 0x05, 0x03, 0x00, 0x00)      /* 39 ''' */ \
+  X (0x00, 0x1C, 0x22, 0x41, 0x00)      /* 40 '(' */ \
+  X (0x00, 0x41, 0x22, 0x1C, 0x00)      /* 41 ')' */ \
+  X (0x14, 0x08, 0x3E, 0x08, 0x14)      /* 42 '*' */ \
+  X (0x08, 0x08, 0x3E, 0x08, 0x08)      /* 43 '+' */ \
+  X (0x00, 0x50, 0x30, 0x00, 0x00)      /* 44 ',' */ \
+  X (0x08, 0x08, 0x08, 0x08, 0x08)      /* 45 '-' */ \
+  X (0x00, 0x60, 0x60, 0x00, 0x00)      /* 46 '.' */ \
+  X (0x20, 0x10, 0x08, 0x04, 0x02)      /* 47 '/' */ \
+  X (0x3E, 0x51, 0x49, 0x45, 0x3E)      /* 48 '0' */ \
+  X (0x00, 0x42, 0x7F, 0x40, 0x00)      /* 49 '1' */ \
+  X (0x42, 0x61, 0x51, 0x49, 0x46)      /* 50 '2' */ \
+  X (0x21, 0x41, 0x45, 0x4B, 0x31)      /* 51 '3' */ \
+  X (0x18, 0x14, 0x12, 0x7F, 0x10)      /* 52 '4' */ \
+  X (0x27, 0x45, 0x45, 0x45, 0x39)      /* 53 '5' */ \
+  X (0x3C, 0x4A, 0x49, 0x49, 0x30)      /* 54 '6' */ \
+  X (0x01, 0x71, 0x09, 0x05, 0x03)      /* 55 '7' */ \
+  X (0x36, 0x49, 0x49, 0x49, 0x36)      /* 56 '8' */ \
+  X (0x06, 0x49, 0x49, 0x29, 0x1E)      /* 57 '9' */ \
+  X (0x00, 0x36, 0x36, 0x00, 0x00)      /* 58 ':' */ \
+  X (0x00, 0x56, 0x36, 0x00, 0x00)      /* 59 ';' */ \
+  X (0x08, 0x14, 0x22, 0x41, 0x00)      /* 60 '<' */ \
+  X (0x14, 0x14, 0x14, 0x14, 0x14)      /* 61 '=' */ \
+  X (0x00, 0x41, 0x22, 0x14, 0x08)      /* 62 '>' */ \
+  X (0x02, 0x01, 0x51, 0x09, 0x06)      /* 63 '?' */ \
+  X (0x32, 0x49, 0x79, 0x41, 0x3E)      /* 64 '@' */ \
+  X (0x7E, 0x11, 0x11, 0x11, 0x7E)      /* 65 'A' */ \
+  X (0x7F, 0x49, 0x49, 0x49, 0x36)      /* 66 'B' */ \
+  X (0x3E, 0x41, 0x41, 0x41, 0x22)      /* 67 'C' */ \
+  X (0x7F, 0x41, 0x41, 0x22, 0x1C)      /* 68 'D' */ \
+  X (0x7F, 0x49, 0x49, 0x49, 0x41)      /* 69 'E' */ \
+  X (0x7F, 0x09, 0x09, 0x09, 0x01)      /* 70 'F' */ \
+  X (0x3E, 0x41, 0x49, 0x49, 0x7A)      /* 71 'G' */ \
+  X (0x7F, 0x08, 0x08, 0x08, 0x7F)      /* 72 'H' */ \
+  X (0x00, 0x41, 0x7F, 0x41, 0x00)      /* 73 'I' */ \
+  X (0x20, 0x40, 0x41, 0x3F, 0x01)      /* 74 'J' */ \
+  X (0x7F, 0x08, 0x14, 0x22, 0x41)      /* 75 'K' */ \
+  X (0x7F, 0x40, 0x40, 0x40, 0x40)      /* 76 'L' */ \
+  X (0x7F, 0x02, 0x0C, 0x02, 0x7F)      /* 77 'M' */ \
+  X (0x7F, 0x04, 0x08, 0x10, 0x7F)      /* 78 'N' */ \
+  X (0x3E, 0x41, 0x41, 0x41, 0x3E)      /* 79 'O' */ \
+  X (0x7F, 0x09, 0x09, 0x09, 0x06)      /* 80 'P' */ \
+  X (0x3E, 0x41, 0x51, 0x21, 0x5E)      /* 81 'Q' */ \
+  X (0x7F, 0x09, 0x19, 0x29, 0x46)      /* 82 'R' */ \
+  X (0x46, 0x49, 0x49, 0x49, 0x31)      /* 83 'S' */ \
+  X (0x01, 0x01, 0x7F, 0x01, 0x01)      /* 84 'T' */ \
+  X (0x3F, 0x40, 0x40, 0x40, 0x3F)      /* 85 'U' */ \
+  X (0x1F, 0x20, 0x40, 0x20, 0x1F)      /* 86 'V' */ \
+  X (0x3F, 0x40, 0x38, 0x40, 0x3F)      /* 87 'W' */ \
+  X (0x63, 0x14, 0x08, 0x14, 0x63)      /* 88 'X' */ \
+  X (0x07, 0x08, 0x70, 0x08, 0x07)      /* 89 'Y' */ \
+  X (0x61, 0x51, 0x49, 0x45, 0x43)      /* 90 'Z' */ \
+  X (0x00, 0x7F, 0x41, 0x41, 0x00)      /* 91 '[' */ \
+  X (0x02, 0x04, 0x08, 0x10, 0x20)      /* 92 '\\' */ \
+  X (0x00, 0x41, 0x41, 0x7F, 0x00)      /* 93 ']' */ \
+  X (0x04, 0x02, 0x01, 0x02, 0x04)      /* 94 '^' */ \
+  X (0x80, 0x80, 0x80, 0x80, 0x80)      /* 95 '_' */ \
+  X (0x00, 0x01, 0x02, 0x04, 0x00)      /* 96 '`' */ \
+  X (0x20, 0x54, 0x54, 0x54, 0x78)      /* 97 'a' */ \
+  X (0x7F, 0x48, 0x44, 0x44, 0x38)      /* 98 'b' */ \
+  X (0x38, 0x44, 0x44, 0x44, 0x20)      /* 99 'c' */ \
+  X (0x38, 0x44, 0x44, 0x48, 0x7F)      /* 100 'd' */ \
+  X (0x38, 0x54, 0x54, 0x54, 0x18)      /* 101 'e' */ \
+  X (0x08, 0x7E, 0x09, 0x01, 0x02)      /* 102 'f' */ \
+  X (0x0C, 0x52, 0x52, 0x52, 0x3E)      /* 103 'g' */ \
+  X (0x7F, 0x08, 0x04, 0x04, 0x78)      /* 104 'h' */ \
+  X (0x00, 0x44, 0x7D, 0x40, 0x00)      /* 105 'i' */ \
+  X (0x20, 0x40, 0x44, 0x3D, 0x00)      /* 106 'j' */ \
+  X (0x7F, 0x10, 0x28, 0x44, 0x00)      /* 107 'k' */ \
+  X (0x00, 0x41, 0x7F, 0x40, 0x00)      /* 108 'l' */ \
+  X (0x7C, 0x04, 0x18, 0x04, 0x78)      /* 109 'm' */ \
+  X (0x7C, 0x08, 0x04, 0x04, 0x78)      /* 110 'n' */ \
+  X (0x38, 0x44, 0x44, 0x44, 0x38)      /* 111 'o' */ \
+  X (0x7C, 0x14, 0x14, 0x14, 0x08)      /* 112 'p' */ \
+  X (0x08, 0x14, 0x14, 0x14, 0x7C)      /* 113 'q' */ \
+  X (0x7C, 0x08, 0x04, 0x04, 0x08)      /* 114 'r' */ \
+  X (0x48, 0x54, 0x54, 0x54, 0x20)      /* 115 's' */ \
+  X (0x04, 0x3F, 0x44, 0x40, 0x20)      /* 116 't' */ \
+  X (0x3C, 0x40, 0x40, 0x20, 0x7C)      /* 117 'u' */ \
+  X (0x1C, 0x20, 0x40, 0x20, 0x1C)      /* 118 'v' */ \
+  X (0x3C, 0x40, 0x30, 0x40, 0x3C)      /* 119 'w' */ \
+  X (0x44, 0x28, 0x10, 0x28, 0x44)      /* 120 'x' */ \
+  X (0x0C, 0x50, 0x50, 0x50, 0x3C)      /* 121 'y' */ \
+  X (0x44, 0x64, 0x54, 0x4C, 0x44)      /* 122 'z' */ \
+  X (0x08, 0x36, 0x41, 0x41, 0x00)      /* 123 '{' */ \
+  X (0x00, 0x00, 0x7F, 0x00, 0x00)      /* 124 '|' */ \
+  X (0x00, 0x41, 0x41, 0x36, 0x08)      /* 125 '}' */ \
+  X (0x08, 0x04, 0x08, 0x10, 0x08)      /* 126 '~' */ \
+  X (0x00, 0x00, 0x00, 0x00, 0x00)      /* 127 DEL, blank */
+
+#define GLYPH_COLS(a, b, c, d, e) { a, b, c, d, e },
+static const uint8_t font5x7[96][5] = { FONT5X7 (GLYPH_COLS) };
+
+// Proportional metrics: trim empty columns on both sides. A blank glyph
+// keeps one (empty) column.
+#define GLYPH_LEFT(a, b, c, d, e)  ((a) ? 0 : (b) ? 1 : (c) ? 2 : (d) ? 3 : (e) ? 4 : 0)
+#define GLYPH_RIGHT(a, b, c, d, e) ((e) ? 4 : (d) ? 3 : (c) ? 2 : (b) ? 1 : 0)
+#define GLYPH_METRIC(a, b, c, d, e) \
+  { GLYPH_LEFT (a, b, c, d, e), GLYPH_RIGHT (a, b, c, d, e) - GLYPH_LEFT (a, b, c, d, e) + 1 },
+
+struct glyph_metric
+{
+  uint8_t left;                 // first visible column
+  uint8_t width;                // visible columns
 };
 
-// Compute proportional width by trimming empty columns
-static int
-glyph_width (uint8_t glyph[5])
+static const struct glyph_metric glyph_metrics[96] = { FONT5X7 (GLYPH_METRIC) };
+
+#define GLYPH_ROWS_MASK 0x7F    // glyphs are 7 rows tall; row 7 is never drawn
+
+// Write one 7-pixel glyph column at (x, y): rows y..y+6 are set from bits
+// and cleared where bits is 0, touching at most two pages.
+static void
+blit_column (int x, int y, uint8_t bits)
 {
-  int left = 0, right = 4;
-  while (left < 5) {
-    if (glyph[left])
-      break;
-    left++;
+  if (x < 0 || x >= SSD1306_WIDTH || y <= -7 || y >= SSD1306_HEIGHT)
+    return;
+  int page = (y < 0) ? -1 : y / 8;
+  int shift = y - page * 8;
+  uint16_t mask = (uint16_t) GLYPH_ROWS_MASK << shift;
+  uint16_t val = (uint16_t) (bits & GLYPH_ROWS_MASK) << shift;
+
+  if (page >= 0) {
+    uint8_t *p = &oled_buf[page * SSD1306_WIDTH + x];
+    *p = (*p & ~(uint8_t) mask) | (uint8_t) val;
+    dirty_add (oled_dirty, page, x, x);
   }
-  while (right >= 0) {
-    if (glyph[right])
-      break;
-    right--;
+  if ((mask >> 8) && page + 1 < SSD1306_PAGES) {
+    uint8_t *p = &oled_buf[(page + 1) * SSD1306_WIDTH + x];
+    *p = (*p & ~(uint8_t) (mask >> 8)) | (uint8_t) (val >> 8);
+    dirty_add (oled_dirty, page + 1, x, x);
   }
-  int w = right - left + 1;
-  if (w <= 0)
-    w = 1;
-  if (w > 5)
-    w = 5;
-  return w;
 }
 
-static void
+// Draw c at (x, y); returns its advance width without spacing
+static int
 draw_char_prop (int x, int y, char c)
 {
   if (c < 32 || c > 127)
     c = '?';
   const uint8_t *g = font5x7[c - 32];
-  // Determine visible columns
-  int left = 0, right = 4;
-  while (left < 5 && g[left] == 0)
-    left++;
-  while (right >= 0 && g[right] == 0)
-    right--;
-  if (right < left) {
-    right = left;
-  }                             // at least 1 col
-  int w = right - left + 1;
-  for (int col = 0; col < w; ++col) {
-    uint8_t bits = g[left + col];
-    for (int row = 0; row < 7; ++row) {
-      bool on = (bits >> row) & 1;
-      ssd1306_set_pixel (x + col, y + row, on);
-    }
+  const struct glyph_metric *m = &glyph_metrics[c - 32];
+  for (int col = 0; col < m->width; ++col)
+    blit_column (x + col, y, g[m->left + col]);
+  return m->width;
+}
+
+int
+ssd1306_text_width (const char *s)
+{
+  int w = 0;
+  for (; *s && *s != '\n'; ++s) {
+    char c = *s;
+    if (c < 32 || c > 127)
+      c = '?';
+    w += glyph_metrics[c - 32].width + 1;       // 1px spacing
   }
+  return w;
 }
 
 int
@@ -325,14 +745,7 @@ draw_text_prop (int x, int y, const char *s)
       cursor = x;
       continue;
     }
-    if (c < 32 || c > 127)
-      c = '?';
-    uint8_t glyph[5];
-    memcpy (glyph, font5x7[c - 32], 5);
-    // draw
-    draw_char_prop (cursor, y, c);
-    int w = glyph_width (glyph);
-    cursor += w + 1;            // 1px spacing
+    cursor += draw_char_prop (cursor, y, c) + 1;        // 1px spacing
     if (cursor >= SSD1306_WIDTH)
       break;
   }
@@ -342,9 +755,10 @@ draw_text_prop (int x, int y, const char *s)
 void
 ssd1306_shutdown (void)
 {
-  if (i2c_fd >= 0) {
-    close(i2c_fd);
-    i2c_fd = -1;
+  ssd1306_stop_render_thread ();
+  if (xport_open) {
+    xport->close ();
+    xport_open = 0;
   }
 }
 
@@ -353,7 +767,7 @@ ssd1306_shutdown (void)
  * Tiny unit-test main() for ssd1306.c
  *
  * Enable by changing #if 0 -> #if 1, then build:
- *   gcc -O2 -Wall -Wextra -o ssd1306_test ssd1306.c
+ *   gcc -O2 -Wall -Wextra -o ssd1306_test ssd1306.c ssd1306_i2c.c ssd1306_spi.c i2c_bus.c -lpthread -lgpiod
  *
  * It will draw a border + some text for a few seconds, then blink.
  */
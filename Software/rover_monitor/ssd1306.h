@@ -10,9 +10,18 @@ extern "C" {
 
 #define SSD1306_WIDTH   128
 #define SSD1306_HEIGHT   64
+#define SSD1306_PAGES   (SSD1306_HEIGHT / 8)
 #define SSD1306_BUF_SZ  (SSD1306_WIDTH * SSD1306_HEIGHT / 8)
 
-/* Initialize SSD1306 on I2C (defaults: OLED_I2C_DEV=/dev/i2c-1, OLED_ADDR=0x3c).
+struct ssd1306_transport;
+
+/* Pick the transport (ssd1306_transport.h) before ssd1306_init().
+ * Default is ssd1306_i2c_transport.
+ */
+void ssd1306_set_transport(const struct ssd1306_transport *t);
+
+/* Open the transport and initialize the panel
+ * (I2C defaults: OLED_I2C_DEV=/dev/i2c-1, OLED_ADDR=0x3c).
  * Returns 0 on success, -1 on error.
  */
 int  ssd1306_init(void);
@@ -21,15 +30,91 @@ void ssd1306_shutdown(void);
 void ssd1306_clear(void);
 void ssd1306_set_pixel(int x, int y, bool on);
 void ssd1306_hline(int x0, int x1, int y, bool on);
+void ssd1306_fill_rect(int x, int y, int w, int h, bool on);
+
+/* Move the contents of a box n columns left; the n columns freed on the
+ * right are cleared.
+ */
+void ssd1306_shift_left(int x, int y, int w, int h, int n);
+
+/* Drawing calls record the area they touch, and ssd1306_update() only
+ * compares and sends those parts. Code that writes the framebuffer some
+ * other way reports its area here.
+ */
+void ssd1306_mark_dirty(int x, int y, int w, int h);
 
-/* Push framebuffer to display. Returns 0 on success, -1 on error. */
+/* Publish the framebuffer. With the render thread running this only
+ * hands the frame over and returns 0; the thread pushes the newest one
+ * and drops frames it never got to. Without it the frame is pushed here.
+ * Either way only the parts that changed since the last successful push
+ * go out (the whole frame after init or an error).
+ * Returns 0 on success, -1 on error.
+ */
 int  ssd1306_update(void);
 
+/* Render thread owning the display transport. Optional: until it is
+ * started ssd1306_update() pushes synchronously. ssd1306_shutdown()
+ * stops it after sending the last published frame.
+ */
+int  ssd1306_start_render_thread(void);
+void ssd1306_stop_render_thread(void);
+
+/* Hardware horizontal scroll of pages page0..page1 (full width, wrapping
+ * around). Applied by whoever pushes frames. Every push stops the scroll,
+ * rewrites the scrolled pages and restarts it; the pages are written
+ * rotated by the estimated distance already scrolled, so the motion
+ * carries on. Transports that don't reach the controller directly (the
+ * kernel framebuffer) ignore it. Call with the display lock held.
+ */
+enum ssd1306_scroll_dir {
+  SSD1306_SCROLL_RIGHT = 0x26,
+  SSD1306_SCROLL_LEFT  = 0x27
+};
+
+/* Time per one column step, in frames (controller codes) */
+enum ssd1306_scroll_step {
+  SSD1306_SCROLL_5_FRAMES   = 0,
+  SSD1306_SCROLL_64_FRAMES  = 1,
+  SSD1306_SCROLL_128_FRAMES = 2,
+  SSD1306_SCROLL_256_FRAMES = 3,
+  SSD1306_SCROLL_3_FRAMES   = 4,
+  SSD1306_SCROLL_4_FRAMES   = 5,
+  SSD1306_SCROLL_25_FRAMES  = 6,
+  SSD1306_SCROLL_2_FRAMES   = 7
+};
+
+/* Panel refresh rate with the init clock settings (0xD5 0x80, 0xD9 0xF1):
+ * ~370 kHz / (66 DCLK * 64 rows). Only used to estimate scroll timing.
+ */
+#ifndef SSD1306_FRAME_HZ
+#define SSD1306_FRAME_HZ 88
+#endif
+
+int  ssd1306_scroll_start(enum ssd1306_scroll_dir dir, int page0, int page1,
+                          enum ssd1306_scroll_step step);
+int  ssd1306_scroll_stop(void);
+
+/* Estimated time for one full 128 column revolution */
+unsigned int ssd1306_scroll_period_ms(enum ssd1306_scroll_step step);
+
+/* Drawing lock. Threads that draw must hold it from their first drawing
+ * call through ssd1306_update() so their frames don't interleave.
+ */
+void ssd1306_lock(void);
+void ssd1306_unlock(void);
+
+/* Frames replaced before the render thread sent them, and failed pushes */
+unsigned long ssd1306_frames_dropped(void);
+unsigned long ssd1306_push_errors(void);
+
 /* Proportional 5x7-ish text helper used by rover_monitor.
  * Returns the x cursor after drawing.
  */
 int  draw_text_prop(int x, int y, const char *s);
 
+/* Width in pixels draw_text_prop() advances for s (up to a newline) */
+int  ssd1306_text_width(const char *s);
+
 #ifdef __cplusplus
 }
 #endif
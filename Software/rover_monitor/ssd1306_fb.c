@@ -0,0 +1,118 @@
+/*
+ * ssd1306_fb.c - SSD1306 transport on the kernel framebuffer (ssd1307fb)
+ *
+ * With the ssd1306 overlay loaded (e.g. dtoverlay=ssd1306,inverted for our
+ * rotated mounting) the kernel owns the panel and exposes it as a 1 bpp
+ * /dev/fbN. We mmap it once; after that a span is just stores into the
+ * mapping, with no syscalls. The kernel's deferred I/O notices the touched
+ * memory pages and sends them on its own schedule.
+ *
+ * The fbdev layout is row-major, one bit per pixel, LSB = leftmost pixel,
+ * while our framebuffer is SSD1306 page-organized, so each dirty span is
+ * transposed into the mapping here. The kernel driver has already set up
+ * the panel, so commands (init, scroll) are not forwarded.
+ */
+
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+
+#include <fcntl.h>
+#include <linux/fb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef OLED_FB_DEV
+#define OLED_FB_DEV "/dev/fb1"          // fb0 is normally HDMI
+#endif
+
+static int fb_fd = -1;
+static uint8_t *fb_mem = MAP_FAILED;
+static size_t fb_len = 0;
+static size_t fb_stride = 0;            // bytes per row
+
+static void
+fb_close (void)
+{
+  if (fb_mem != MAP_FAILED) {
+    munmap (fb_mem, fb_len);
+    fb_mem = MAP_FAILED;
+  }
+  if (fb_fd >= 0) {
+    close (fb_fd);
+    fb_fd = -1;
+  }
+}
+
+static int
+fb_open (void)
+{
+  struct fb_var_screeninfo var;
+  struct fb_fix_screeninfo fix;
+
+  fb_fd = open (OLED_FB_DEV, O_RDWR | O_CLOEXEC);
+  if (fb_fd < 0) {
+    perror ("ssd1306_fb: open " OLED_FB_DEV);
+    return -1;
+  }
+  if (ioctl (fb_fd, FBIOGET_VSCREENINFO, &var) < 0 ||
+      ioctl (fb_fd, FBIOGET_FSCREENINFO, &fix) < 0) {
+    perror ("ssd1306_fb: FBIOGET_*SCREENINFO");
+    fb_close ();
+    return -1;
+  }
+  if (var.bits_per_pixel != 1 || var.xres < SSD1306_WIDTH || var.yres < SSD1306_HEIGHT) {
+    fprintf (stderr, "ssd1306_fb: %s is %ux%u %u bpp, need %dx%d 1 bpp\n", OLED_FB_DEV,
+             var.xres, var.yres, var.bits_per_pixel, SSD1306_WIDTH, SSD1306_HEIGHT);
+    fb_close ();
+    return -1;
+  }
+
+  fb_stride = fix.line_length;
+  fb_len = fix.smem_len;
+  fb_mem = mmap (NULL, fb_len, PROT_READ | PROT_WRITE, MAP_SHARED, fb_fd, 0);
+  if (fb_mem == MAP_FAILED) {
+    perror ("ssd1306_fb: mmap");
+    fb_close ();
+    return -1;
+  }
+  return 0;
+}
+
+static int
+fb_cmds (const uint8_t *cmds, size_t n)
+{
+  (void) cmds;
+  (void) n;
+  return 0;                     // the kernel driver owns the controller
+}
+
+// Transpose columns c0..c1 of one page (a byte per column, LSB = top row)
+// into 8 rows of the mapping (a bit per column, LSB = leftmost)
+static int
+fb_span (int page, int c0, int c1, const uint8_t *data)
+{
+  for (int r = 0; r < 8; r++) {
+    uint8_t *row = fb_mem + (size_t) (page * 8 + r) * fb_stride;
+    for (int c = c0; c <= c1; c++) {
+      uint8_t bit = 1 << (c & 7);
+      if ((data[c - c0] >> r) & 1)
+        row[c >> 3] |= bit;
+      else
+        row[c >> 3] &= ~bit;
+    }
+  }
+  return 0;
+}
+
+const struct ssd1306_transport ssd1306_fb_transport = {
+  .name = "fbdev",
+  .can_scroll = 0,
+  .open = fb_open,
+  .close = fb_close,
+  .cmds = fb_cmds,
+  .span = fb_span,
+};
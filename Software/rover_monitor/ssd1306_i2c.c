@@ -0,0 +1,76 @@
+/*
+ * ssd1306_i2c.c - SSD1306 I2C transport on the shared bus
+ */
+
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+#include "i2c_bus.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef OLED_I2C_DEV
+#define OLED_I2C_DEV   I2C_BUS_DEV
+#endif
+
+#ifndef OLED_ADDR
+#define OLED_ADDR      0x3c
+#endif
+
+// Control bytes: the first byte of every write says what follows
+#define OLED_CTRL_CMD   0x00
+#define OLED_CTRL_DATA  0x40
+
+static int
+i2c_open (void)
+{
+  return i2c_bus_open (OLED_I2C_DEV);
+}
+
+static void
+i2c_close (void)
+{
+  i2c_bus_close ();
+}
+
+// All display traffic is low priority on the shared bus. A command
+// sequence goes out as one write behind a single control byte; the SSD1306
+// keeps taking commands until the stop.
+static int
+i2c_cmds (const uint8_t *cmds, size_t n)
+{
+  uint8_t buf[1 + SSD1306_CMD_MAX];
+  buf[0] = OLED_CTRL_CMD;
+  memcpy (&buf[1], cmds, n);
+  return i2c_bus_write (OLED_ADDR, buf, n + 1, I2C_BUS_PRIO_LOW);
+}
+
+// The address window and the data go out as one transaction (repeated
+// start between them). A full 128 byte page is ~3 ms at 400 kHz, the
+// longest a sensor read can wait behind the display.
+static int
+i2c_span (int page, int c0, int c1, const uint8_t *src)
+{
+  uint8_t cmd[7] = { OLED_CTRL_CMD, 0x21, c0, c1,       // column window
+    0x22, page, page            // page window
+  };
+  uint8_t data[1 + SSD1306_WIDTH];
+  size_t n = c1 - c0 + 1;
+  struct i2c_msg msgs[2] = {
+    {.addr = OLED_ADDR,.flags = 0,.len = sizeof (cmd),.buf = cmd},
+    {.addr = OLED_ADDR,.flags = 0,.len = n + 1,.buf = data},
+  };
+
+  data[0] = OLED_CTRL_DATA;
+  memcpy (&data[1], src, n);
+  return i2c_bus_xfer (msgs, 2, I2C_BUS_PRIO_LOW);
+}
+
+const struct ssd1306_transport ssd1306_i2c_transport = {
+  .name = "i2c",
+  .can_scroll = 1,
+  .open = i2c_open,
+  .close = i2c_close,
+  .cmds = i2c_cmds,
+  .span = i2c_span,
+};
@@ -0,0 +1,167 @@
+/*
+ * ssd1306_spi.c - SSD1306/SSD1309 4-wire SPI transport
+ *
+ * Bytes go out through spidev; D/C (low = command, high = data) and the
+ * panel reset are GPIO outputs driven with libgpiod. The display is then
+ * off the I2C bus the INA260s use, and at 8 MHz a full page takes ~130 us
+ * instead of ~3 ms.
+ *
+ * Wiring (BCM numbering): MOSI GPIO10, SCLK GPIO11, CS CE0 (GPIO8),
+ * D/C GPIO25, RST GPIO24. Needs dtparam=spi=on.
+ */
+
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gpiod.h>              // libgpiod v1.6.3
+#include <linux/spi/spidev.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#ifndef OLED_SPI_DEV
+#define OLED_SPI_DEV       "/dev/spidev0.0"
+#endif
+
+#ifndef OLED_SPI_HZ
+#define OLED_SPI_HZ        8000000      // SSD1306 allows 10 MHz (100 ns SCLK)
+#endif
+
+#ifndef OLED_SPI_GPIOCHIP
+#define OLED_SPI_GPIOCHIP  "gpiochip0"
+#endif
+
+#ifndef OLED_SPI_DC_PIN
+#define OLED_SPI_DC_PIN    25
+#endif
+
+#ifndef OLED_SPI_RST_PIN
+#define OLED_SPI_RST_PIN   24
+#endif
+
+static int spi_fd = -1;
+static struct gpiod_chip *spi_chip = NULL;
+static struct gpiod_line *dc_line = NULL;
+static struct gpiod_line *rst_line = NULL;
+static int dc_level = -1;       // last level written to D/C
+
+static void
+spi_close (void)
+{
+  if (dc_line) {
+    gpiod_line_release (dc_line);
+    dc_line = NULL;
+  }
+  if (rst_line) {
+    gpiod_line_release (rst_line);
+    rst_line = NULL;
+  }
+  if (spi_chip) {
+    gpiod_chip_close (spi_chip);
+    spi_chip = NULL;
+  }
+  if (spi_fd >= 0) {
+    close (spi_fd);
+    spi_fd = -1;
+  }
+  dc_level = -1;
+}
+
+static int
+spi_open (void)
+{
+  uint8_t mode = SPI_MODE_0;
+  uint8_t bits = 8;
+  uint32_t hz = OLED_SPI_HZ;
+
+  spi_fd = open (OLED_SPI_DEV, O_RDWR | O_CLOEXEC);
+  if (spi_fd < 0) {
+    perror ("ssd1306_spi: open " OLED_SPI_DEV);
+    return -1;
+  }
+  if (ioctl (spi_fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+      ioctl (spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+      ioctl (spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &hz) < 0) {
+    perror ("ssd1306_spi: configure");
+    spi_close ();
+    return -1;
+  }
+
+  spi_chip = gpiod_chip_open_by_name (OLED_SPI_GPIOCHIP);
+  if (!spi_chip) {
+    perror ("ssd1306_spi: gpiod_chip_open_by_name");
+    spi_close ();
+    return -1;
+  }
+  dc_line = gpiod_chip_get_line (spi_chip, OLED_SPI_DC_PIN);
+  rst_line = gpiod_chip_get_line (spi_chip, OLED_SPI_RST_PIN);
+  if (!dc_line || !rst_line ||
+      gpiod_line_request_output (dc_line, "ssd1306-dc", 0) < 0) {
+    perror ("ssd1306_spi: request D/C");
+    dc_line = NULL;
+    spi_close ();
+    return -1;
+  }
+  dc_level = 0;
+  if (gpiod_line_request_output (rst_line, "ssd1306-rst", 1) < 0) {
+    perror ("ssd1306_spi: request RST");
+    rst_line = NULL;
+    spi_close ();
+    return -1;
+  }
+
+  // Reset pulse; the datasheet wants >= 3 us low, then wait before commands
+  gpiod_line_set_value (rst_line, 0);
+  usleep (10 * 1000);
+  gpiod_line_set_value (rst_line, 1);
+  usleep (10 * 1000);
+  return 0;
+}
+
+static int
+spi_send (int dc, const uint8_t *buf, size_t n)
+{
+  if (dc != dc_level) {
+    if (gpiod_line_set_value (dc_line, dc) < 0)
+      return -1;
+    dc_level = dc;
+  }
+  struct spi_ioc_transfer tr = {
+    .tx_buf = (unsigned long) buf,
+    .len = n,
+    .speed_hz = OLED_SPI_HZ,
+    .bits_per_word = 8,
+  };
+  return (ioctl (spi_fd, SPI_IOC_MESSAGE (1), &tr) == (int) n) ? 0 : -1;
+}
+
+static int
+spi_cmds (const uint8_t *cmds, size_t n)
+{
+  return spi_send (0, cmds, n);
+}
+
+static int
+spi_span (int page, int c0, int c1, const uint8_t *data)
+{
+  uint8_t cmd[6] = { 0x21, c0, c1,      // column window
+    0x22, page, page            // page window
+  };
+
+  if (spi_send (0, cmd, sizeof (cmd)) < 0)
+    return -1;
+  return spi_send (1, data, c1 - c0 + 1);
+}
+
+const struct ssd1306_transport ssd1306_spi_transport = {
+  .name = "spi",
+  .can_scroll = 1,
+  .open = spi_open,
+  .close = spi_close,
+  .cmds = spi_cmds,
+  .span = spi_span,
+};
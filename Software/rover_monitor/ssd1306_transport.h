@@ -0,0 +1,63 @@
+#ifndef SSD1306_TRANSPORT_H
+#define SSD1306_TRANSPORT_H
+
+/*
+ * ssd1306_transport.h - how ssd1306.c gets bytes to the panel
+ *
+ * The driver core keeps the framebuffer, dirty tracking and scrolling;
+ * a transport only moves command and data bytes. Transports are used by
+ * one thread at a time (the render thread, or the caller holding the
+ * display lock), so they need no locking of their own.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest command sequence a transport must accept in one call */
+#define SSD1306_CMD_MAX 32
+
+struct ssd1306_transport {
+  const char *name;
+  int can_scroll;               /* panel gets our commands, so hardware scroll works */
+
+  /* Acquire the bus / device (and reset the panel if wired).
+   * Returns 0 on success, -1 on error.
+   */
+  int  (*open)(void);
+  void (*close)(void);
+
+  /* Send n command bytes (n <= SSD1306_CMD_MAX). Returns 0 or -1. */
+  int  (*cmds)(const uint8_t *cmds, size_t n);
+
+  /* Write columns c0..c1 of one page: set the column/page address
+   * window, then send the c1 - c0 + 1 data bytes. Returns 0 or -1.
+   */
+  int  (*span)(int page, int c0, int c1, const uint8_t *data);
+
+  /* Optional: called after each update, changed != 0 if any span was
+   * written. May be NULL.
+   */
+  void (*flush)(int changed);
+};
+
+/* I2C through the shared bus manager (i2c_bus.h), ssd1306_i2c.c */
+extern const struct ssd1306_transport ssd1306_i2c_transport;
+
+/* 4-wire SPI through spidev with D/C and reset on GPIOs, ssd1306_spi.c */
+extern const struct ssd1306_transport ssd1306_spi_transport;
+
+/* Kernel ssd1307fb framebuffer, mmapped, ssd1306_fb.c */
+extern const struct ssd1306_transport ssd1306_fb_transport;
+
+/* In-memory panel for running without hardware, ssd1306_virtual.c */
+extern const struct ssd1306_transport ssd1306_virtual_transport;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * ssd1306_virtual.c - in-memory SSD1306 transport
+ *
+ * Spans land in a copy of the panel RAM instead of on a bus. Traffic is
+ * counted as the I2C transport would send it (one transaction per command
+ * stream and per span, payload bytes including control bytes), so
+ * rendering changes can be measured on any Linux box.
+ */
+
+#include "ssd1306_virtual.h"
+#include "ssd1306_transport.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static struct ssd1306_virtual_config vcfg;
+static struct ssd1306_virtual_stats vstats;
+static uint8_t vram[SSD1306_BUF_SZ];
+static struct ssd1306_virtual_shm *vshm = MAP_FAILED;
+
+void
+ssd1306_virtual_configure (const struct ssd1306_virtual_config *cfg)
+{
+  vcfg = *cfg;
+}
+
+void
+ssd1306_virtual_get_stats (struct ssd1306_virtual_stats *out)
+{
+  *out = vstats;
+}
+
+const uint8_t *
+ssd1306_virtual_frame (void)
+{
+  return vram;
+}
+
+static int
+virt_open (void)
+{
+  memset (vram, 0, sizeof (vram));
+  memset (&vstats, 0, sizeof (vstats));
+  if (!vcfg.shm_name)
+    return 0;
+
+  int fd = shm_open (vcfg.shm_name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    perror ("ssd1306_virtual: shm_open");
+    return -1;
+  }
+  if (ftruncate (fd, sizeof (*vshm)) < 0) {
+    perror ("ssd1306_virtual: ftruncate");
+    close (fd);
+    return -1;
+  }
+  vshm = mmap (NULL, sizeof (*vshm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (vshm == MAP_FAILED) {
+    perror ("ssd1306_virtual: mmap");
+    return -1;
+  }
+  vshm->magic = SSD1306_VIRTUAL_MAGIC;
+  vshm->width = SSD1306_WIDTH;
+  vshm->height = SSD1306_HEIGHT;
+  atomic_store (&vshm->seq, 0);
+  return 0;
+}
+
+static void
+virt_close (void)
+{
+  if (vshm != MAP_FAILED) {
+    munmap (vshm, sizeof (*vshm));
+    vshm = MAP_FAILED;
+    // Leave the segment for a viewer; shm_unlink() it to remove
+  }
+}
+
+static int
+virt_cmds (const uint8_t *cmds, size_t n)
+{
+  (void) cmds;
+  vstats.xfers++;
+  vstats.bytes += 1 + n;        // control byte + commands
+  return 0;
+}
+
+static int
+virt_span (int page, int c0, int c1, const uint8_t *data)
+{
+  size_t n = c1 - c0 + 1;
+  memcpy (&vram[page * SSD1306_WIDTH + c0], data, n);
+  vstats.xfers++;
+  vstats.bytes += 7 + 1 + n;    // window commands, then control byte + data
+  return 0;
+}
+
+// Binary PBM: rows top to bottom, MSB = leftmost, 1 = black. Lit pixels
+// are written black so frames read as dark text on white.
+static void
+write_pbm (void)
+{
+  char path[512];
+  uint8_t row[SSD1306_WIDTH / 8];
+
+  snprintf (path, sizeof (path), "%s/frame_%06lu.pbm", vcfg.pbm_dir, vstats.pbm_files);
+  FILE *f = fopen (path, "wb");
+  if (!f) {
+    perror ("ssd1306_virtual: fopen pbm");
+    return;
+  }
+  fprintf (f, "P4\n%d %d\n", SSD1306_WIDTH, SSD1306_HEIGHT);
+  for (int y = 0; y < SSD1306_HEIGHT; y++) {
+    const uint8_t *page = &vram[(y / 8) * SSD1306_WIDTH];
+    memset (row, 0, sizeof (row));
+    for (int x = 0; x < SSD1306_WIDTH; x++) {
+      if ((page[x] >> (y & 7)) & 1)
+        row[x / 8] |= 0x80 >> (x & 7);
+    }
+    fwrite (row, 1, sizeof (row), f);
+  }
+  fclose (f);
+  vstats.pbm_files++;
+}
+
+static void
+virt_flush (int changed)
+{
+  vstats.updates++;
+  if (changed)
+    vstats.changed++;
+  if (!changed && !vcfg.every_frame)
+    return;
+
+  if (vcfg.pbm_dir)
+    write_pbm ();
+  if (vshm != MAP_FAILED) {
+    uint32_t seq = atomic_load_explicit (&vshm->seq, memory_order_relaxed);
+    atomic_store_explicit (&vshm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence (memory_order_release);
+    memcpy (vshm->frame, vram, sizeof (vram));
+    atomic_store_explicit (&vshm->seq, seq + 2, memory_order_release);
+  }
+}
+
+const struct ssd1306_transport ssd1306_virtual_transport = {
+  .name = "virtual",
+  .can_scroll = 0,              // nothing scrolls the frame; keep it as drawn
+  .open = virt_open,
+  .close = virt_close,
+  .cmds = virt_cmds,
+  .span = virt_span,
+  .flush = virt_flush,
+};
@@ -0,0 +1,60 @@
+#ifndef SSD1306_VIRTUAL_H
+#define SSD1306_VIRTUAL_H
+
+/*
+ * ssd1306_virtual.h - in-memory SSD1306 for running without hardware
+ *
+ * ssd1306_virtual_transport (ssd1306_transport.h) keeps the panel RAM in
+ * memory and counts what the I2C transport would have put on the bus.
+ * Frames can be written out as PBM files and/or published in a POSIX
+ * shared memory segment for a viewer.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "ssd1306.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ssd1306_virtual_config {
+  const char *pbm_dir;          /* write <dir>/frame_NNNNNN.pbm, or NULL */
+  const char *shm_name;         /* shm_open() name such as "/rover_oled", or NULL */
+  int every_frame;              /* output every update, not only changed ones */
+};
+
+/* Set before ssd1306_init(). Default: no output, counting only. */
+void ssd1306_virtual_configure(const struct ssd1306_virtual_config *cfg);
+
+/* Shared memory layout. seq is odd while the frame is being written,
+ * so a reader copies the frame and retries if seq changed or was odd.
+ */
+#define SSD1306_VIRTUAL_MAGIC 0x31363331u       /* "1361" */
+
+struct ssd1306_virtual_shm {
+  uint32_t magic;
+  uint32_t width, height;
+  _Atomic uint32_t seq;
+  uint8_t frame[SSD1306_BUF_SZ]; /* page organized, LSB = top row */
+};
+
+struct ssd1306_virtual_stats {
+  unsigned long updates;        /* ssd1306 pushes (flush calls) */
+  unsigned long changed;        /* of those, with at least one span */
+  unsigned long xfers;          /* I2C transactions a real panel would need */
+  unsigned long bytes;          /* their payload bytes */
+  unsigned long pbm_files;
+};
+
+void ssd1306_virtual_get_stats(struct ssd1306_virtual_stats *out);
+
+/* Panel RAM as written so far */
+const uint8_t *ssd1306_virtual_frame(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * status_screen.c - the main status page
+ */
+
+#include "status_screen.h"
+#include "oled_widget.h"
+#include "ssd1306.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Status page as retained fields: a refresh redraws only the fields whose
+// text changed. 'shown' is cleared by any page that takes over the display.
+static struct
+{
+  bool shown;
+  struct oled_field host_label, host, ip_label, ip, cpu, bat, used, rover;
+  struct oled_sparkline volts, amps;    // right of the CPU and Rover App lines
+  struct oled_marquee host_line;        // replaces the Host fields when the name is too long
+} status_page;
+
+// Sparklines keep their history across page changes, so set them up once
+void
+status_page_init (int32_t volts_lo, int32_t volts_hi, int32_t amps_hi)
+{
+  oled_spark_init (&status_page.volts, 80, 20, SSD1306_WIDTH - 80, OLED_FIELD_LINE_H,
+                   volts_lo, volts_hi);
+  oled_spark_init (&status_page.amps, 80, 50, SSD1306_WIDTH - 80, OLED_FIELD_LINE_H,
+                   0, amps_hi);
+}
+
+static void
+status_page_layout (void)
+{
+  oled_field_init (&status_page.host_label, 0, 0, 34, OLED_FIELD_LINE_H);
+  oled_field_init (&status_page.host, 34, 0, SSD1306_WIDTH - 34, OLED_FIELD_LINE_H);
+  oled_field_init (&status_page.ip_label, 0, 10, 24, OLED_FIELD_LINE_H);
+  oled_field_init (&status_page.ip, 24, 10, SSD1306_WIDTH - 24, OLED_FIELD_LINE_H);
+  oled_field_init (&status_page.cpu, 0, 20, 78, OLED_FIELD_LINE_H);
+  oled_field_init (&status_page.bat, 0, 30, SSD1306_WIDTH, OLED_FIELD_LINE_H);
+  oled_field_init (&status_page.used, 0, 40, SSD1306_WIDTH, OLED_FIELD_LINE_H);
+  oled_field_init (&status_page.rover, 0, 50, 78, OLED_FIELD_LINE_H);
+  oled_spark_invalidate (&status_page.volts);
+  oled_spark_invalidate (&status_page.amps);
+  oled_marquee_init (&status_page.host_line, 0);
+}
+
+void
+status_page_hide (void)
+{
+  status_page.shown = false;
+  oled_marquee_invalidate (&status_page.host_line);
+}
+
+void
+draw_status_screen (const char *hostname, const char *ip, const char *ssid, double tempC,
+                    const char *uptime, const struct ina260_sample *bat,
+                    const struct energy_totals *energy, int rover_on)
+{
+  int changed = 0;
+
+  ssd1306_lock ();
+  if (!status_page.shown) {
+    ssd1306_clear ();
+    status_page_layout ();
+    status_page.shown = true;
+  }
+
+  const char *host = hostname && *hostname ? hostname : "—";
+  if (status_page.host.x + ssd1306_text_width (host) <= SSD1306_WIDTH) {
+    if (status_page.host_line.drawn) {
+      oled_marquee_invalidate (&status_page.host_line);
+      oled_field_invalidate (&status_page.host_label);
+      oled_field_invalidate (&status_page.host);
+    }
+    changed |= oled_field_set (&status_page.host_label, "Host: ");
+    changed |= oled_field_set (&status_page.host, host);
+  }
+  else {
+    // Too long for the line: scroll the whole line in hardware
+    char line[OLED_MARQUEE_TEXT_MAX];
+    snprintf (line, sizeof (line), "Host: %s", host);
+    oled_field_invalidate (&status_page.host_label);
+    oled_field_invalidate (&status_page.host);
+    changed |= oled_marquee_set (&status_page.host_line, line);
+  }
+  changed |= oled_field_set (&status_page.ip_label, "IP: ");
+  changed |= oled_field_set (&status_page.ip, ip && *ip ? ip : "—");
+
+//  draw_text_prop (0, y, "SSID: ");
+//  draw_text_prop (34, y, ssid && *ssid ? ssid : "—");
+
+  // snprintf(tbuf, sizeof tbuf, "CPU: %.1f\xC2\xB0""C", tempC);
+  changed |= oled_field_setf (&status_page.cpu, "CPU: %.1f " "C", tempC);
+
+//    char ubuf[32]; snprintf(ubuf, sizeof ubuf, "Up: %s", uptime);
+
+  if (bat)
+    changed |= oled_field_setf (&status_page.bat, "Bat:  %3.2fV,   %3.2fA",
+                                ina260_raw_to_mV (bat->voltage_raw) / 1000.0,
+                                ina260_raw_to_mA (bat->current_raw) / 1000.0);
+  else
+    changed |= oled_field_set (&status_page.bat, "Bat:  --");
+
+  // Charge and energy drawn from the pack since the monitor started
+  changed |= oled_field_setf (&status_page.used, "Used: %.0fmAh,  %.2fWh", energy->run_mAh,
+                              energy->run_mWh / 1000.0);
+
+  changed |= oled_field_set (&status_page.rover,
+                             rover_on ? "Rover App:  On" : "Rover App:  Off");
+  changed |= oled_spark_draw (&status_page.volts);
+  changed |= oled_spark_draw (&status_page.amps);
+
+  if (changed)
+    ssd1306_update ();
+  ssd1306_unlock ();
+}
+
+void
+status_page_spark_add (int32_t v_min, int32_t v_max, int32_t i_min, int32_t i_max)
+{
+  oled_spark_add (&status_page.volts, v_min, v_max);
+  oled_spark_add (&status_page.amps, i_min, i_max);
+}
+
+void
+status_page_spark_push (void)
+{
+  ssd1306_lock ();
+  if (!status_page.shown) {
+    // Another page has the screen; just record history
+    oled_spark_invalidate (&status_page.volts);
+    oled_spark_invalidate (&status_page.amps);
+  }
+  int changed = oled_spark_push (&status_page.volts);
+  changed |= oled_spark_push (&status_page.amps);
+  if (changed)
+    ssd1306_update ();
+  ssd1306_unlock ();
+}
+
+void
+status_page_tick (void)
+{
+  ssd1306_lock ();
+  if (status_page.shown && oled_marquee_tick (&status_page.host_line))
+    ssd1306_update ();
+  ssd1306_unlock ();
+}
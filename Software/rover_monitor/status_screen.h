@@ -0,0 +1,51 @@
+#ifndef STATUS_SCREEN_H
+#define STATUS_SCREEN_H
+
+#include <stdint.h>
+
+#include "energy.h"
+#include "ina260.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The main status page: host, IP, CPU temperature, battery readings,
+ * energy used and the rover app state, plus voltage and current
+ * sparklines. Built from retained fields (oled_widget.h), so a redraw
+ * only touches what changed.
+ */
+
+/* Set up the sparklines once, before the first draw. Ranges are INA260
+ * raw counts; the current sparkline starts at 0.
+ */
+void status_page_init(int32_t volts_lo, int32_t volts_hi, int32_t amps_hi);
+
+/* Another page is taking the screen; call with the display lock held.
+ * The next draw_status_screen() clears and redraws the whole page.
+ */
+void status_page_hide(void);
+
+/* Refresh the page and push it if anything changed. bat may be NULL
+ * when there is no reading. Takes the display lock.
+ */
+void draw_status_screen(const char *hostname, const char *ip, const char *ssid, double tempC,
+                        const char *uptime, const struct ina260_sample *bat,
+                        const struct energy_totals *energy, int rover_on);
+
+/* Fold one tick's battery range into the current sparkline column */
+void status_page_spark_add(int32_t v_min, int32_t v_max, int32_t i_min, int32_t i_max);
+
+/* Scroll in a new sparkline column. Takes the display lock. */
+void status_page_spark_push(void);
+
+/* Move a scrolling host name on to its next segment when due.
+ * Takes the display lock.
+ */
+void status_page_tick(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
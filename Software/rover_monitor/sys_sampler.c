@@ -0,0 +1,77 @@
+/* sys_sampler.c
+ *
+ * One pread() per source per sample, into a stack buffer.
+ */
+
+#include "sys_sampler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Longest prefix of a file we look at; the numbers we want come first */
+#define SYS_SAMPLER_BUF 64
+
+int sys_parse_fixed(const char *buf, int len, int frac_digits, int64_t *out) {
+    int i = 0, neg = 0, digits = 0;
+    int64_t v = 0;
+
+    while (i < len && (buf[i] == ' ' || buf[i] == '\t' || buf[i] == '\n'))
+        i++;
+    if (i < len && (buf[i] == '-' || buf[i] == '+'))
+        neg = buf[i++] == '-';
+    for (; i < len && buf[i] >= '0' && buf[i] <= '9'; i++, digits++)
+        v = v * 10 + (buf[i] - '0');
+    if (digits == 0)
+        return -1;
+
+    int f = 0;
+    if (i < len && buf[i] == '.') {
+        for (i++; i < len && buf[i] >= '0' && buf[i] <= '9' && f < frac_digits; i++, f++)
+            v = v * 10 + (buf[i] - '0');
+    }
+    for (; f < frac_digits; f++)
+        v *= 10;
+
+    *out = neg ? -v : v;
+    return 0;
+}
+
+int sys_sampler_open(struct sys_source *src, int n) {
+    int opened = 0;
+
+    for (int i = 0; i < n; i++) {
+        src[i].valid = 0;
+        src[i].fd = open(src[i].path, O_RDONLY | O_CLOEXEC);
+        if (src[i].fd >= 0)
+            opened++;
+    }
+    return opened;
+}
+
+int sys_sampler_read(struct sys_source *src, int n) {
+    char buf[SYS_SAMPLER_BUF];
+    int valid = 0;
+
+    for (int i = 0; i < n; i++) {
+        struct sys_source *s = &src[i];
+        if (s->fd < 0)
+            continue;
+        ssize_t len;
+        do {
+            len = pread(s->fd, buf, sizeof(buf), 0);
+        } while (len < 0 && errno == EINTR);
+        s->valid = len > 0 && sys_parse_fixed(buf, (int)len, s->frac_digits, &s->value) == 0;
+        valid += s->valid;
+    }
+    return valid;
+}
+
+void sys_sampler_close(struct sys_source *src, int n) {
+    for (int i = 0; i < n; i++) {
+        if (src[i].fd >= 0)
+            close(src[i].fd);
+        src[i].fd = -1;
+        src[i].valid = 0;
+    }
+}
@@ -0,0 +1,46 @@
+/* sys_sampler.h
+ *
+ * Cheap reads of numeric sysfs/procfs files. Each source is opened once
+ * and re-read with pread() at offset 0 (sysfs and procfs regenerate the
+ * contents on every read from the start), then parsed in place without
+ * stdio or allocation. One call samples a whole table of sources.
+ */
+
+#ifndef SYS_SAMPLER_H
+#define SYS_SAMPLER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sys_source {
+    const char *path;
+    int frac_digits;        /* keep this many decimals: "123.45" with 2 -> 12345 */
+    int fd;                 /* set by sys_sampler_open(), -1 if unavailable */
+    int valid;              /* value below is from the last read */
+    int64_t value;          /* first number in the file, scaled by 10^frac_digits */
+};
+
+/* Open every source in the table. Sources that can't be opened stay
+ * invalid. Returns the number opened.
+ */
+int sys_sampler_open(struct sys_source *src, int n);
+
+/* Re-read and parse every open source. Returns the number valid. */
+int sys_sampler_read(struct sys_source *src, int n);
+
+void sys_sampler_close(struct sys_source *src, int n);
+
+/* Parse the first number in buf[0..len), skipping leading blanks. An
+ * optional sign and fraction are allowed; the fraction is truncated or
+ * padded to frac_digits. Returns 0, or -1 if there is no number.
+ */
+int sys_parse_fixed(const char *buf, int len, int frac_digits, int64_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SYS_SAMPLER_H */
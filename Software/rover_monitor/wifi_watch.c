@@ -0,0 +1,410 @@
+/* wifi_watch.c
+ *
+ * Two generic netlink sockets: g_req for request/reply (blocking, with a
+ * receive timeout so a stuck driver can't hang the caller) and g_evt
+ * joined to the multicast groups, so replies and events never mix.
+ * Attributes are built and parsed by hand; no libnl.
+ *
+ * A link read is the same as `iw dev X link`: a scan dump for the BSS
+ * marked associated (BSSID, SSID from its information elements), then
+ * GET_STATION on that BSSID for the signal and bitrate.
+ */
+
+#include "wifi_watch.h"
+
+#include <errno.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/nl80211.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef WIFI_WATCH_TIMEOUT_MS
+#define WIFI_WATCH_TIMEOUT_MS 1000
+#endif
+
+#define NLA_DATA(nla)   ((void *)((char *)(nla) + NLA_HDRLEN))
+#define NLA_LEN(nla)    ((int)(nla)->nla_len - NLA_HDRLEN)
+#define NLA_TYPE(nla)   ((nla)->nla_type & NLA_TYPE_MASK)
+
+static int g_req = -1;
+static int g_evt = -1;
+static uint16_t g_family;           /* nl80211 generic netlink id */
+static uint32_t g_seq;
+static char g_want[IF_NAMESIZE];    /* requested interface, or "" */
+static struct wifi_link g_link;
+
+/* ---- attribute helpers ---- */
+
+struct nl_req {
+    struct nlmsghdr nh;
+    struct genlmsghdr gh;
+    char attrs[64];
+};
+
+static void _put(struct nl_req *r, uint16_t type, const void *data, int len) {
+    struct nlattr *nla = (struct nlattr *)((char *)r + NLMSG_ALIGN(r->nh.nlmsg_len));
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    memcpy(NLA_DATA(nla), data, len);
+    r->nh.nlmsg_len = NLMSG_ALIGN(r->nh.nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+/* Index the attributes in [head, head + len) by type; unknown and
+ * out of range types are skipped.
+ */
+static void _parse(const struct nlattr **tb, int max, const void *head, int len) {
+    const struct nlattr *nla = head;
+
+    memset(tb, 0, sizeof(*tb) * (max + 1));
+    while (len >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN && nla->nla_len <= len) {
+        if (NLA_TYPE(nla) <= max)
+            tb[NLA_TYPE(nla)] = nla;
+        len -= NLA_ALIGN(nla->nla_len);
+        nla = (const struct nlattr *)((const char *)nla + NLA_ALIGN(nla->nla_len));
+    }
+}
+
+static void _parse_msg(const struct nlattr **tb, int max, const struct nlmsghdr *nh) {
+    _parse(tb, max, (const char *)NLMSG_DATA(nh) + GENL_HDRLEN,
+           nh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+}
+
+static uint32_t _u32(const struct nlattr *nla) {
+    uint32_t v;
+    memcpy(&v, NLA_DATA(nla), sizeof(v));
+    return v;
+}
+
+static uint16_t _u16(const struct nlattr *nla) {
+    uint16_t v;
+    memcpy(&v, NLA_DATA(nla), sizeof(v));
+    return v;
+}
+
+/* ---- request / reply ---- */
+
+typedef void (*reply_cb_t)(const struct nlmsghdr *nh, void *ctx);
+
+static void _init_req(struct nl_req *r, uint16_t family, uint8_t cmd, uint16_t flags) {
+    memset(r, 0, sizeof(*r));
+    r->nh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    r->nh.nlmsg_type = family;
+    r->nh.nlmsg_flags = NLM_F_REQUEST | flags;
+    r->nh.nlmsg_seq = ++g_seq;
+    r->gh.cmd = cmd;
+    r->gh.version = 1;
+}
+
+/* Send r and pass each reply message to cb until the dump ends or the
+ * request is acknowledged. Returns 0, or -1 with errno set.
+ */
+static int _transact(struct nl_req *r, reply_cb_t cb, void *ctx) {
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+    // Dumps end with NLMSG_DONE; ask for an ACK to end everything else
+    if (!(r->nh.nlmsg_flags & NLM_F_DUMP))
+        r->nh.nlmsg_flags |= NLM_F_ACK;
+    if (send(g_req, r, r->nh.nlmsg_len, 0) < 0)
+        return -1;
+
+    for (;;) {
+        ssize_t n = recv(g_req, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;              /* includes EAGAIN on timeout */
+        }
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, n); nh = NLMSG_NEXT(nh, n)) {
+            if (nh->nlmsg_seq != r->nh.nlmsg_seq)
+                continue;           /* late reply to an earlier, timed out request */
+            if (nh->nlmsg_type == NLMSG_DONE)
+                return 0;
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *err = NLMSG_DATA(nh);
+                errno = -err->error;
+                return err->error ? -1 : 0;
+            }
+            cb(nh, ctx);
+        }
+    }
+}
+
+/* ---- nl80211 family and groups ---- */
+
+struct family_info {
+    uint16_t id;
+    uint32_t mlme_grp;
+    uint32_t config_grp;
+};
+
+static void _family_reply(const struct nlmsghdr *nh, void *ctx) {
+    struct family_info *fi = ctx;
+    const struct nlattr *tb[CTRL_ATTR_MAX + 1];
+
+    _parse_msg(tb, CTRL_ATTR_MAX, nh);
+    if (tb[CTRL_ATTR_FAMILY_ID])
+        fi->id = _u16(tb[CTRL_ATTR_FAMILY_ID]);
+    if (!tb[CTRL_ATTR_MCAST_GROUPS])
+        return;
+
+    // Nested list of groups, each a nest of name and id
+    const struct nlattr *grp = NLA_DATA(tb[CTRL_ATTR_MCAST_GROUPS]);
+    int len = NLA_LEN(tb[CTRL_ATTR_MCAST_GROUPS]);
+    while (len >= NLA_HDRLEN && grp->nla_len >= NLA_HDRLEN && grp->nla_len <= len) {
+        const struct nlattr *g[CTRL_ATTR_MCAST_GRP_MAX + 1];
+        _parse(g, CTRL_ATTR_MCAST_GRP_MAX, NLA_DATA(grp), NLA_LEN(grp));
+        if (g[CTRL_ATTR_MCAST_GRP_NAME] && g[CTRL_ATTR_MCAST_GRP_ID]) {
+            const char *name = NLA_DATA(g[CTRL_ATTR_MCAST_GRP_NAME]);
+            if (strcmp(name, NL80211_MULTICAST_GROUP_MLME) == 0)
+                fi->mlme_grp = _u32(g[CTRL_ATTR_MCAST_GRP_ID]);
+            else if (strcmp(name, NL80211_MULTICAST_GROUP_CONFIG) == 0)
+                fi->config_grp = _u32(g[CTRL_ATTR_MCAST_GRP_ID]);
+        }
+        len -= NLA_ALIGN(grp->nla_len);
+        grp = (const struct nlattr *)((const char *)grp + NLA_ALIGN(grp->nla_len));
+    }
+}
+
+/* ---- link state ---- */
+
+static void _iface_reply(const struct nlmsghdr *nh, void *ctx) {
+    struct wifi_link *l = ctx;
+    const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+
+    if (l->ifindex)
+        return;                     /* already found one */
+    _parse_msg(tb, NL80211_ATTR_MAX, nh);
+    if (!tb[NL80211_ATTR_IFINDEX] || !tb[NL80211_ATTR_IFNAME] || !tb[NL80211_ATTR_IFTYPE])
+        return;
+    if (_u32(tb[NL80211_ATTR_IFTYPE]) != NL80211_IFTYPE_STATION)
+        return;
+    const char *name = NLA_DATA(tb[NL80211_ATTR_IFNAME]);
+    if (g_want[0] && strcmp(name, g_want) != 0)
+        return;
+    l->ifindex = (int)_u32(tb[NL80211_ATTR_IFINDEX]);
+    snprintf(l->ifname, sizeof(l->ifname), "%s", name);
+}
+
+static void _scan_reply(const struct nlmsghdr *nh, void *ctx) {
+    struct wifi_link *l = ctx;
+    const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    const struct nlattr *bss[NL80211_BSS_MAX + 1];
+
+    _parse_msg(tb, NL80211_ATTR_MAX, nh);
+    if (!tb[NL80211_ATTR_BSS])
+        return;
+    _parse(bss, NL80211_BSS_MAX, NLA_DATA(tb[NL80211_ATTR_BSS]), NLA_LEN(tb[NL80211_ATTR_BSS]));
+    if (!bss[NL80211_BSS_STATUS] || !bss[NL80211_BSS_BSSID])
+        return;
+    uint32_t status = _u32(bss[NL80211_BSS_STATUS]);
+    if (status != NL80211_BSS_STATUS_ASSOCIATED && status != NL80211_BSS_STATUS_IBSS_JOINED)
+        return;
+
+    l->associated = 1;
+    memcpy(l->bssid, NLA_DATA(bss[NL80211_BSS_BSSID]), sizeof(l->bssid));
+    if (!bss[NL80211_BSS_INFORMATION_ELEMENTS])
+        return;
+
+    // Information elements: id, len, data. The SSID is element 0.
+    const uint8_t *ie = NLA_DATA(bss[NL80211_BSS_INFORMATION_ELEMENTS]);
+    int left = NLA_LEN(bss[NL80211_BSS_INFORMATION_ELEMENTS]);
+    while (left >= 2 && ie[1] + 2 <= left) {
+        if (ie[0] == 0 && ie[1] < sizeof(l->ssid)) {
+            for (int i = 0; i < ie[1]; i++)
+                l->ssid[i] = (ie[2 + i] >= 0x20 && ie[2 + i] < 0x7F) ? ie[2 + i] : '?';
+            l->ssid[ie[1]] = '\0';
+            break;
+        }
+        left -= ie[1] + 2;
+        ie += ie[1] + 2;
+    }
+}
+
+static void _station_reply(const struct nlmsghdr *nh, void *ctx) {
+    struct wifi_link *l = ctx;
+    const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    const struct nlattr *sta[NL80211_STA_INFO_MAX + 1];
+    const struct nlattr *rate[NL80211_RATE_INFO_MAX + 1];
+
+    _parse_msg(tb, NL80211_ATTR_MAX, nh);
+    if (!tb[NL80211_ATTR_STA_INFO])
+        return;
+    _parse(sta, NL80211_STA_INFO_MAX, NLA_DATA(tb[NL80211_ATTR_STA_INFO]),
+           NLA_LEN(tb[NL80211_ATTR_STA_INFO]));
+    if (sta[NL80211_STA_INFO_SIGNAL])
+        l->signal_dbm = *(const int8_t *)NLA_DATA(sta[NL80211_STA_INFO_SIGNAL]);
+    if (sta[NL80211_STA_INFO_TX_BITRATE]) {
+        _parse(rate, NL80211_RATE_INFO_MAX, NLA_DATA(sta[NL80211_STA_INFO_TX_BITRATE]),
+               NLA_LEN(sta[NL80211_STA_INFO_TX_BITRATE]));
+        if (rate[NL80211_RATE_INFO_BITRATE32])
+            l->bitrate_kbps = _u32(rate[NL80211_RATE_INFO_BITRATE32]) * 100;
+        else if (rate[NL80211_RATE_INFO_BITRATE])
+            l->bitrate_kbps = _u16(rate[NL80211_RATE_INFO_BITRATE]) * 100;
+    }
+}
+
+/* Read the link into l. Returns 0, or -1 if a request failed. */
+static int _read_link(struct wifi_link *l) {
+    struct nl_req r;
+    int ifindex = g_link.ifindex;
+
+    memset(l, 0, sizeof(*l));
+    if (!ifindex) {
+        _init_req(&r, g_family, NL80211_CMD_GET_INTERFACE, NLM_F_DUMP);
+        if (_transact(&r, _iface_reply, l) < 0)
+            return -1;
+        if (!l->ifindex)
+            return 0;               /* no station interface (yet) */
+        ifindex = l->ifindex;
+    }
+    else {
+        l->ifindex = ifindex;
+        memcpy(l->ifname, g_link.ifname, sizeof(l->ifname));
+    }
+
+    uint32_t idx = (uint32_t)ifindex;
+    _init_req(&r, g_family, NL80211_CMD_GET_SCAN, NLM_F_DUMP);
+    _put(&r, NL80211_ATTR_IFINDEX, &idx, sizeof(idx));
+    if (_transact(&r, _scan_reply, l) < 0) {
+        if (errno == ENODEV)
+            l->ifindex = 0;         /* interface went away; look again next time */
+        return errno == ENODEV ? 0 : -1;
+    }
+    if (!l->associated)
+        return 0;
+
+    _init_req(&r, g_family, NL80211_CMD_GET_STATION, 0);
+    _put(&r, NL80211_ATTR_IFINDEX, &idx, sizeof(idx));
+    _put(&r, NL80211_ATTR_MAC, l->bssid, sizeof(l->bssid));
+    if (_transact(&r, _station_reply, l) < 0 && errno != ENOENT)
+        return -1;                  /* ENOENT: disassociated meanwhile */
+    return 0;
+}
+
+int wifi_watch_refresh(void) {
+    struct wifi_link l;
+
+    if (g_req < 0)
+        return -1;
+    if (_read_link(&l) < 0) {
+        perror("wifi_watch: nl80211");
+        return -1;
+    }
+    int changed = l.associated != g_link.associated || strcmp(l.ssid, g_link.ssid) != 0;
+    g_link = l;
+    return changed;
+}
+
+int wifi_watch_process(void) {
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    int relevant = 0;
+
+    if (g_evt < 0)
+        return -1;
+    for (;;) {
+        ssize_t n = recv(g_evt, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                relevant = 1;       /* events lost; just re-read */
+                continue;
+            }
+            perror("wifi_watch: recv");
+            return -1;
+        }
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, n); nh = NLMSG_NEXT(nh, n)) {
+            if (nh->nlmsg_type != g_family)
+                continue;
+            const struct genlmsghdr *gh = NLMSG_DATA(nh);
+            const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+            _parse_msg(tb, NL80211_ATTR_MAX, nh);
+            int ifindex = tb[NL80211_ATTR_IFINDEX] ? (int)_u32(tb[NL80211_ATTR_IFINDEX]) : 0;
+
+            switch (gh->cmd) {
+            case NL80211_CMD_CONNECT:
+            case NL80211_CMD_ROAM:
+            case NL80211_CMD_DISCONNECT:
+                if (ifindex == g_link.ifindex)
+                    relevant = 1;
+                break;
+            case NL80211_CMD_DEL_INTERFACE:
+                if (ifindex == g_link.ifindex) {
+                    g_link.ifindex = 0;     /* look for another one */
+                    relevant = 1;
+                }
+                break;
+            case NL80211_CMD_NEW_INTERFACE:
+                if (!g_link.ifindex)
+                    relevant = 1;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    return relevant ? wifi_watch_refresh() : 0;
+}
+
+const struct wifi_link *wifi_watch_link(void) {
+    return &g_link;
+}
+
+int wifi_watch_open(const char *ifname) {
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    struct timeval tv = {
+        .tv_sec = WIFI_WATCH_TIMEOUT_MS / 1000,
+        .tv_usec = (WIFI_WATCH_TIMEOUT_MS % 1000) * 1000,
+    };
+    struct family_info fi = { 0 };
+    struct nl_req r;
+
+    memset(&g_link, 0, sizeof(g_link));
+    snprintf(g_want, sizeof(g_want), "%s", ifname ? ifname : "");
+
+    g_req = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    g_evt = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (g_req < 0 || g_evt < 0 ||
+        bind(g_req, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+        bind(g_evt, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        perror("wifi_watch: socket");
+        wifi_watch_close();
+        return -1;
+    }
+    setsockopt(g_req, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    _init_req(&r, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+    _put(&r, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME));
+    if (_transact(&r, _family_reply, &fi) < 0 || !fi.id) {
+        perror("wifi_watch: nl80211 family");
+        wifi_watch_close();
+        return -1;
+    }
+    g_family = fi.id;
+
+    // Join the groups before the first read so no change can slip between
+    if (fi.mlme_grp)
+        setsockopt(g_evt, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &fi.mlme_grp, sizeof(fi.mlme_grp));
+    if (fi.config_grp)
+        setsockopt(g_evt, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &fi.config_grp, sizeof(fi.config_grp));
+
+    if (wifi_watch_refresh() < 0) {
+        wifi_watch_close();
+        return -1;
+    }
+    return g_evt;
+}
+
+void wifi_watch_close(void) {
+    if (g_req >= 0)
+        close(g_req);
+    if (g_evt >= 0)
+        close(g_evt);
+    g_req = g_evt = -1;
+}
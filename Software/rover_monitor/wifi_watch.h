@@ -0,0 +1,57 @@
+/* wifi_watch.h
+ *
+ * Wi-Fi link state over nl80211 (generic netlink), without forking
+ * iwgetid/iw. The SSID, BSSID, signal and TX bitrate of the station
+ * interface are read with a few request/reply round trips, and only
+ * again when the kernel reports a connect, roam or disconnect on the
+ * nl80211 "mlme" multicast group (or a new interface on "config").
+ */
+
+#ifndef WIFI_WATCH_H
+#define WIFI_WATCH_H
+
+#include <net/if.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct wifi_link {
+    int ifindex;                    /* 0 if no station interface was found */
+    char ifname[IF_NAMESIZE];
+    int associated;
+    char ssid[33];                  /* non-printable bytes shown as '?' */
+    uint8_t bssid[6];
+    int signal_dbm;                 /* last received frame */
+    unsigned int bitrate_kbps;      /* TX bitrate, 0 if unknown */
+};
+
+/* Resolve nl80211, subscribe to its events and read the link of the
+ * named station interface (NULL: the first one found). Succeeds without
+ * a station interface; it is picked up when one appears.
+ * Returns the event fd to poll for POLLIN / EPOLLIN, or -1 on error.
+ */
+int wifi_watch_open(const char *ifname);
+
+/* Handle queued events without blocking, re-reading the link if they
+ * concern it. Returns 1 if the association or SSID changed, 0 if not,
+ * -1 on error.
+ */
+int wifi_watch_process(void);
+
+/* Re-read the link now, e.g. to refresh signal and bitrate.
+ * Returns 1 if the association or SSID changed, 0 if not, -1 on error.
+ */
+int wifi_watch_refresh(void);
+
+/* Link state as last read */
+const struct wifi_link *wifi_watch_link(void);
+
+void wifi_watch_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WIFI_WATCH_H */